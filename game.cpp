@@ -1,9 +1,50 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OVERWORLD_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OVERWORLD_SIMD_NEON 1
+#endif
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <cctype>
+#include <iterator>
+#include <new>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 struct Vec3 {
     float x;
@@ -11,10 +52,36 @@ struct Vec3 {
     float z;
 };
 
-struct Mat4 {
+// Column-major 4x4 matrix; 16-byte aligned so SIMD paths can load columns directly
+struct alignas(16) Mat4 {
     float m[16];
 };
 
+// Per-frame values shared by every program through the FrameData uniform block.
+// Layout must match the std140 block declared in the shaders.
+struct FrameUniforms {
+    Mat4 view;
+    Mat4 projection;
+    float viewPos[4];   // xyz = camera position
+    float lightDir[4];  // xyz = direction the sun light travels
+};
+
+static const GLuint frameDataBinding = 0;
+static const GLuint shadowDataBinding = 1;
+static const GLuint lightGridBinding = 2;
+
+// Linked program plus every active uniform location, resolved once at link time
+struct ShaderProgram {
+    GLuint id = 0;
+    uint64_t binaryKey = 0;  // Program binary cache entry it came from or was saved to (0 = none)
+    std::unordered_map<std::string, GLint> uniforms;
+
+    GLint uniform(const std::string& name) const {
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second : -1;
+    }
+};
+
 static float clamp(float v, float minV, float maxV) {
     return (v < minV) ? minV : (v > maxV) ? maxV : v;
 }
@@ -38,8 +105,36 @@ static Mat4 identity() {
     return r;
 }
 
+// Note: multiply(a, b) applies a first, then b (b * a in column-vector notation).
 static Mat4 multiply(const Mat4& a, const Mat4& b) {
-    Mat4 r{};
+    Mat4 r;
+#if defined(OVERWORLD_SIMD_SSE)
+    __m128 b0 = _mm_load_ps(b.m + 0);
+    __m128 b1 = _mm_load_ps(b.m + 4);
+    __m128 b2 = _mm_load_ps(b.m + 8);
+    __m128 b3 = _mm_load_ps(b.m + 12);
+    for (int row = 0; row < 4; ++row) {
+        const float* a4 = a.m + row * 4;
+        __m128 acc = _mm_mul_ps(_mm_set1_ps(a4[0]), b0);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a4[1]), b1));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a4[2]), b2));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a4[3]), b3));
+        _mm_store_ps(r.m + row * 4, acc);
+    }
+#elif defined(OVERWORLD_SIMD_NEON)
+    float32x4_t b0 = vld1q_f32(b.m + 0);
+    float32x4_t b1 = vld1q_f32(b.m + 4);
+    float32x4_t b2 = vld1q_f32(b.m + 8);
+    float32x4_t b3 = vld1q_f32(b.m + 12);
+    for (int row = 0; row < 4; ++row) {
+        const float* a4 = a.m + row * 4;
+        float32x4_t acc = vmulq_n_f32(b0, a4[0]);
+        acc = vmlaq_n_f32(acc, b1, a4[1]);
+        acc = vmlaq_n_f32(acc, b2, a4[2]);
+        acc = vmlaq_n_f32(acc, b3, a4[3]);
+        vst1q_f32(r.m + row * 4, acc);
+    }
+#else
     for (int row = 0; row < 4; ++row) {
         for (int col = 0; col < 4; ++col) {
             r.m[col + row * 4] =
@@ -49,50 +144,40 @@ static Mat4 multiply(const Mat4& a, const Mat4& b) {
                 a.m[3 + row * 4] * b.m[col + 3 * 4];
         }
     }
+#endif
     return r;
 }
 
-static Mat4 translate(const Vec3& t) {
-    Mat4 r = identity();
-    r.m[12] = t.x;
-    r.m[13] = t.y;
-    r.m[14] = t.z;
-    return r;
-}
-
-static Mat4 scale(const Vec3& s) {
-    Mat4 r = identity();
-    r.m[0] = s.x;
-    r.m[5] = s.y;
-    r.m[10] = s.z;
-    return r;
-}
-
-static Mat4 rotateX(float radians) {
-    Mat4 r = identity();
-    float c = std::cos(radians);
-    float s = std::sin(radians);
-    r.m[5] = c;  r.m[9] = -s;
-    r.m[6] = s;  r.m[10] = c;
-    return r;
-}
-
-static Mat4 rotateY(float radians) {
-    Mat4 r = identity();
-    float c = std::cos(radians);
-    float s = std::sin(radians);
-    r.m[0] = c;  r.m[8] = s;
-    r.m[2] = -s; r.m[10] = c;
-    return r;
-}
+// Batched TRS composition: out[i] = translate(t) * rotateY * rotateX * rotateZ * scale(s),
+// i.e. scale, then rotate Z, X, Y, then translate. The rotation is expanded in closed form,
+// so each object costs three sin/cos pairs and a few dozen multiplies instead of three
+// full 4x4 products. Output is a contiguous, 16-byte aligned matrix buffer.
+// When indices is non-null, out[n] is composed from element indices[n] of the input columns.
+static void composeTransforms(const Vec3* positions, const Vec3* rotations, const Vec3* scales,
+                              const uint32_t* indices, size_t count, Mat4* out) {
+    for (size_t n = 0; n < count; ++n) {
+        size_t i = indices ? indices[n] : n;
+        const Vec3& t = positions[i];
+        const Vec3& a = rotations[i];
+        const Vec3& s = scales[i];
+        float sx = std::sin(a.x), cx = std::cos(a.x);
+        float sy = std::sin(a.y), cy = std::cos(a.y);
+        float sz = std::sin(a.z), cz = std::cos(a.z);
 
-static Mat4 rotateZ(float radians) {
-    Mat4 r = identity();
-    float c = std::cos(radians);
-    float s = std::sin(radians);
-    r.m[0] = c;  r.m[4] = -s;
-    r.m[1] = s;  r.m[5] = c;
-    return r;
+        // Columns of Ry * Rx * Rz, each scaled by its axis scale; w = translation column
+        float* m = out[n].m;
+#if defined(OVERWORLD_SIMD_SSE)
+        _mm_store_ps(m + 0, _mm_mul_ps(_mm_set_ps(0.0f, -sy * cz + cy * sx * sz, cx * sz, cy * cz + sy * sx * sz), _mm_set1_ps(s.x)));
+        _mm_store_ps(m + 4, _mm_mul_ps(_mm_set_ps(0.0f, sy * sz + cy * sx * cz, cx * cz, -cy * sz + sy * sx * cz), _mm_set1_ps(s.y)));
+        _mm_store_ps(m + 8, _mm_mul_ps(_mm_set_ps(0.0f, cy * cx, -sx, sy * cx), _mm_set1_ps(s.z)));
+        _mm_store_ps(m + 12, _mm_set_ps(1.0f, t.z, t.y, t.x));
+#else
+        m[0] = (cy * cz + sy * sx * sz) * s.x;  m[4] = (-cy * sz + sy * sx * cz) * s.y; m[8] = sy * cx * s.z;  m[12] = t.x;
+        m[1] = cx * sz * s.x;                   m[5] = cx * cz * s.y;                   m[9] = -sx * s.z;      m[13] = t.y;
+        m[2] = (-sy * cz + cy * sx * sz) * s.x; m[6] = (sy * sz + cy * sx * cz) * s.y;  m[10] = cy * cx * s.z; m[14] = t.z;
+        m[3] = 0.0f;                            m[7] = 0.0f;                            m[11] = 0.0f;          m[15] = 1.0f;
+#endif
+    }
 }
 
 static Mat4 perspective(float fovRadians, float aspect, float nearZ, float farZ) {
@@ -106,6 +191,17 @@ static Mat4 perspective(float fovRadians, float aspect, float nearZ, float farZ)
     return r;
 }
 
+static Mat4 orthographic(float left, float right, float bottom, float top, float nearZ, float farZ) {
+    Mat4 r = identity();
+    r.m[0] = 2.0f / (right - left);
+    r.m[5] = 2.0f / (top - bottom);
+    r.m[10] = -2.0f / (farZ - nearZ);
+    r.m[12] = -(right + left) / (right - left);
+    r.m[13] = -(top + bottom) / (top - bottom);
+    r.m[14] = -(farZ + nearZ) / (farZ - nearZ);
+    return r;
+}
+
 static Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up) {
     Vec3 f = normalize(sub(center, eye));
     Vec3 s = normalize(cross(f, up));
@@ -121,6 +217,15 @@ static Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up) {
     return r;
 }
 
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 1469598103934665603ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 static GLuint compileShader(GLenum type, const std::string& source) {
     GLuint shader = glCreateShader(type);
     const char* src = source.c_str();
@@ -136,12 +241,8 @@ static GLuint compileShader(GLenum type, const std::string& source) {
     return shader;
 }
 
-static GLuint createProgram(const std::string& vs, const std::string& fs) {
-    GLuint vsId = compileShader(GL_VERTEX_SHADER, vs);
-    GLuint fsId = compileShader(GL_FRAGMENT_SHADER, fs);
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vsId);
-    glAttachShader(program, fsId);
+// Link a program with its shaders attached; returns 0 (after reporting why) on failure
+static GLuint finishLink(GLuint program) {
     glLinkProgram(program);
     GLint success = 0;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -149,12 +250,536 @@ static GLuint createProgram(const std::string& vs, const std::string& fs) {
         char info[1024];
         glGetProgramInfoLog(program, 1024, nullptr, info);
         std::cerr << "Program link error: " << info << std::endl;
+        glDeleteProgram(program);
+        return 0;
     }
+    return program;
+}
+
+// Compile and link; returns 0 (after reporting why) if either step fails
+static GLuint linkProgram(const std::string& vs, const std::string& fs, bool retrievable) {
+    GLuint vsId = compileShader(GL_VERTEX_SHADER, vs);
+    GLuint fsId = compileShader(GL_FRAGMENT_SHADER, fs);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vsId);
+    glAttachShader(program, fsId);
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    program = finishLink(program);
     glDeleteShader(vsId);
     glDeleteShader(fsId);
     return program;
 }
 
+// Compute programs are small and built once at startup, so they skip the binary cache
+static GLuint linkComputeProgram(const std::string& source) {
+    GLuint shader = compileShader(GL_COMPUTE_SHADER, source);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    program = finishLink(program);
+    glDeleteShader(shader);
+    return program;
+}
+
+// Linked program binaries, cached under cache/ and keyed by both sources and the driver
+// (vendor, renderer, version strings): a driver update silently changes the key, and a
+// binary the driver still rejects falls back to compiling
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;  // Driver binary format enum
+    uint32_t length;
+    uint64_t key;
+};
+
+static const uint32_t programBinaryVersion = 1;
+
+static bool programBinariesSupported() {
+    static const bool supported = [] {
+        if (!GLEW_ARB_get_program_binary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+static uint64_t programCacheKey(const std::string& vs, const std::string& fs) {
+    uint64_t hash = fnv1a(vs.data(), vs.size());
+    hash = fnv1a(fs.data(), fs.size(), fnv1a("|", 1, hash));
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        if (value) hash = fnv1a(value, std::strlen(value), hash);
+    }
+    return fnv1a(&programBinaryVersion, sizeof(programBinaryVersion), hash);
+}
+
+static std::string programCacheFile(uint64_t key) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "cache/program_%016llx.bin", static_cast<unsigned long long>(key));
+    return name;
+}
+
+static bool loadProgramBinary(GLuint program, const std::string& path, uint64_t key) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    ProgramBinaryHeader header{};
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, "OWPB", 4) != 0 || header.version != programBinaryVersion ||
+        header.key != key || header.length == 0) {
+        return false;
+    }
+    std::vector<char> binary(header.length);
+    in.read(binary.data(), static_cast<std::streamsize>(binary.size()));
+    if (!in) return false;
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+static void saveProgramBinary(GLuint program, const std::string& path, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not write program cache " << path << std::endl;
+        return;
+    }
+    ProgramBinaryHeader header{{'O', 'W', 'P', 'B'}, programBinaryVersion, format, static_cast<uint32_t>(length), key};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(binary.data(), length);
+}
+
+// Program from the binary cache when the driver accepts it, otherwise compiled and cached.
+// Returns id 0 if the sources don't build.
+static ShaderProgram createProgram(const std::string& vs, const std::string& fs, bool* fromBinary = nullptr) {
+    if (fromBinary) *fromBinary = false;
+    GLuint program = 0;
+    uint64_t key = 0;
+    if (programBinariesSupported()) {
+        key = programCacheKey(vs, fs);
+        std::string path = programCacheFile(key);
+        program = glCreateProgram();
+        if (loadProgramBinary(program, path, key)) {
+            if (fromBinary) *fromBinary = true;
+        } else {
+            glDeleteProgram(program);
+            program = linkProgram(vs, fs, true);
+            if (program) saveProgramBinary(program, path, key);
+        }
+    } else {
+        program = linkProgram(vs, fs, false);
+    }
+
+    ShaderProgram result;
+    result.id = program;
+    if (!program) return result;
+    result.binaryKey = key;
+
+    // Cache every active uniform (block members report -1 and are skipped)
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(static_cast<size_t>(std::max(maxNameLength, 1)));
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), maxNameLength, &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), static_cast<size_t>(length));
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0) continue;
+        // Arrays are reported as "name[0]"; store them under the bare name too
+        size_t bracket = name.find('[');
+        if (bracket != std::string::npos) result.uniforms[name.substr(0, bracket)] = location;
+        result.uniforms[name] = location;
+    }
+
+    GLuint frameBlock = glGetUniformBlockIndex(program, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, frameBlock, frameDataBinding);
+    }
+    GLuint shadowBlock = glGetUniformBlockIndex(program, "ShadowData");
+    if (shadowBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, shadowBlock, shadowDataBinding);
+    }
+    GLuint lightBlock = glGetUniformBlockIndex(program, "LightGrid");
+    if (lightBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, lightBlock, lightGridBinding);
+    }
+    return result;
+}
+
+// Optional terms of the main fragment shader. A variant is compiled per feature mask with a
+// #define for each set bit, so disabled terms cost nothing at runtime.
+enum ShaderFeature : uint32_t {
+    FeatureWrappedDiffuse = 1u << 0,
+    FeatureFresnel = 1u << 1,
+    FeatureRim = 1u << 2,
+    FeatureEnvSpecular = 1u << 3,
+    FeatureShadows = 1u << 4,
+    FeatureFog = 1u << 5,
+    FeaturePointLights = 1u << 6,
+};
+
+struct ShaderFeatureInfo {
+    uint32_t bit;
+    const char* define;
+};
+
+static constexpr ShaderFeatureInfo shaderFeatures[] = {
+    {FeatureWrappedDiffuse, "FEATURE_WRAPPED_DIFFUSE"},
+    {FeatureFresnel, "FEATURE_FRESNEL"},
+    {FeatureRim, "FEATURE_RIM"},
+    {FeatureEnvSpecular, "FEATURE_ENV_SPECULAR"},
+    {FeatureShadows, "FEATURE_SHADOWS"},
+    {FeatureFog, "FEATURE_FOG"},
+    {FeaturePointLights, "FEATURE_POINT_LIGHTS"},
+};
+
+static constexpr uint32_t allShaderFeatures() {
+    uint32_t mask = 0;
+    for (const ShaderFeatureInfo& feature : shaderFeatures) mask |= feature.bit;
+    return mask;
+}
+
+// What each material needs at best; the quality tier then takes features away.
+// Fog stays on in every tier: prop culling relies on it hiding the far cutoff.
+enum class Material { Terrain, Prop, Count };
+enum class ShaderQuality { Low, Medium, High };
+
+static constexpr uint32_t materialFeatures[] = {
+    allShaderFeatures() & ~FeatureRim,  // Terrain: rim only lights the ground at grazing angles
+    allShaderFeatures(),                // Prop
+};
+static constexpr uint32_t qualityFeatures[] = {
+    FeatureFog | FeaturePointLights,                              // Low: Lambert + Blinn-Phong, no shadows
+    allShaderFeatures() & ~(FeatureRim | FeatureEnvSpecular),     // Medium
+    allShaderFeatures(),                                          // High
+};
+static_assert(sizeof(materialFeatures) / sizeof(materialFeatures[0]) == static_cast<size_t>(Material::Count),
+              "one feature mask per material");
+
+static constexpr uint32_t programFeatures(Material material, ShaderQuality quality) {
+    return materialFeatures[static_cast<int>(material)] & qualityFeatures[static_cast<int>(quality)];
+}
+
+static std::string featureDefines(uint32_t features) {
+    std::string defines;
+    for (const ShaderFeatureInfo& feature : shaderFeatures) {
+        if (features & feature.bit) defines += std::string("#define ") + feature.define + " 1\n";
+    }
+    return defines;
+}
+
+// Defines go right after the #version line, which must stay first
+static std::string insertDefines(const std::string& source, const std::string& defines) {
+    if (defines.empty()) return source;
+    size_t version = source.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (lineEnd == std::string::npos) return defines + source;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+// Every program the renderer uses, by stage file name. Stages come from the inline sources
+// unless shaders/<file> exists; those files are watched, and poll() rebuilds any program
+// whose files changed, keeping the old program while the new source fails to build.
+struct ShaderLibrary {
+    struct Stage {
+        std::string file;
+        std::string source;
+        std::filesystem::file_time_type modified{};
+        bool onDisk = false;
+    };
+    struct Entry {
+        Stage vertex, fragment;
+        std::string defines;  // Permutation: inserted into both stages
+        ShaderProgram program;
+
+        ShaderProgram build(bool* fromBinary = nullptr) const {
+            return createProgram(insertDefines(vertex.source, defines), insertDefines(fragment.source, defines),
+                                 fromBinary);
+        }
+    };
+
+    std::string directory = "shaders";
+    std::deque<Entry> entries;  // Deque: load() hands out references that must stay valid
+    int fromBinary = 0;         // Programs restored from the binary cache at startup
+    int compiled = 0;
+    double lastPoll = 0.0;
+
+    // Variants with the same files and defines are built once and shared
+    ShaderProgram& load(const char* vertexFile, const std::string& vertexSource, const char* fragmentFile,
+                        const std::string& fragmentSource, const std::string& defines = {}) {
+        for (Entry& entry : entries) {
+            if (entry.vertex.file == vertexFile && entry.fragment.file == fragmentFile && entry.defines == defines) {
+                return entry.program;
+            }
+        }
+        Entry& entry = entries.emplace_back();
+        entry.vertex = {vertexFile, vertexSource};
+        entry.fragment = {fragmentFile, fragmentSource};
+        entry.defines = defines;
+        readStage(entry.vertex);
+        readStage(entry.fragment);
+        bool cached = false;
+        entry.program = entry.build(&cached);
+        if (cached) ++fromBinary; else ++compiled;
+        return entry.program;
+    }
+
+    // Rebuild programs whose stage files changed; returns true if any program was replaced
+    // (uniform locations must then be looked up again)
+    bool poll(double now) {
+        if (now - lastPoll < 0.5) return false;
+        lastPoll = now;
+        bool replaced = false;
+        for (Entry& entry : entries) {
+            bool changed = readStage(entry.vertex);
+            changed = readStage(entry.fragment) || changed;
+            if (!changed) continue;
+            ShaderProgram program = entry.build();
+            if (!program.id) {
+                std::cerr << "Keeping the previous " << entry.vertex.file << " + " << entry.fragment.file << std::endl;
+                continue;
+            }
+            glDeleteProgram(entry.program.id);
+            uint64_t superseded = entry.program.binaryKey;
+            entry.program = std::move(program);
+            dropBinary(superseded);
+            std::cout << "Reloaded " << entry.vertex.file << " + " << entry.fragment.file << std::endl;
+            replaced = true;
+        }
+        return replaced;
+    }
+
+    // Write the built-in sources to the shader directory (existing files are left alone)
+    void exportSources() const {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        for (const Entry& entry : entries) {
+            for (const Stage* stage : {&entry.vertex, &entry.fragment}) {
+                std::string path = directory + "/" + stage->file;
+                if (std::filesystem::exists(path)) continue;
+                std::ofstream out(path, std::ios::binary);
+                out << stage->source;
+                if (!out) std::cerr << "Could not write " << path << std::endl;
+            }
+        }
+    }
+
+    void destroy() {
+        for (Entry& entry : entries) glDeleteProgram(entry.program.id);
+        entries.clear();
+    }
+
+private:
+    // Each edit keys a new cache file; remove the one a rebuilt program no longer uses
+    // (unless another entry still does) so cache/ doesn't grow while iterating on shaders
+    void dropBinary(uint64_t key) const {
+        if (!key) return;
+        for (const Entry& entry : entries) {
+            if (entry.program.binaryKey == key) return;
+        }
+        std::error_code ec;
+        std::filesystem::remove(programCacheFile(key), ec);
+    }
+
+    // Pick up the stage file if it is new or newer than what we have; true if the source changed
+    bool readStage(Stage& stage) const {
+        std::string path = directory + "/" + stage.file;
+        std::error_code ec;
+        auto modified = std::filesystem::last_write_time(path, ec);
+        if (ec || (stage.onDisk && modified == stage.modified)) return false;
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        stage.modified = modified;
+        stage.onDisk = true;
+        if (source == stage.source) return false;
+        stage.source = std::move(source);
+        return true;
+    }
+};
+
+// CPU-side indexed mesh: deduplicated vertices plus 16-bit triangle indices
+struct MeshData {
+    std::vector<float> vertices;  // floatsPerVertex floats per unique vertex
+    std::vector<GLushort> indices;
+    int floatsPerVertex = 0;
+};
+
+// Compact 16-byte vertex: half-float position, 10:10:10:2 normal, normalized ushort UV
+struct PackedVertex {
+    GLhalf position[4];    // xyz, w unused (keeps the normal 4-byte aligned)
+    GLuint normal;         // GL_INT_2_10_10_10_REV, signed normalized
+    GLushort texCoord[2];  // GL_UNSIGNED_SHORT normalized, UVs must lie in [0, 1]
+};
+
+static GLhalf floatToHalf(float value) {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFFu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+    if (exponent <= 0) {
+        // Too small for a normal half: flush to a denormal or signed zero
+        if (exponent < -10) return static_cast<GLhalf>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) ++half;  // Round to nearest
+        return static_cast<GLhalf>(sign | half);
+    }
+    if (exponent >= 31) return static_cast<GLhalf>(sign | 0x7C00u);  // Overflow to infinity
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) ++half;  // Round to nearest (carries into the exponent correctly)
+    return static_cast<GLhalf>(half);
+}
+
+// Shared-exponent RGB9_E5 (GL 3.0 core): 4 bytes per HDR texel instead of 6 for RGB16F
+static GLuint packRgb9e5(float r, float g, float b) {
+    const int bias = 15, mantissaBits = 9;
+    const float maxValue = 65408.0f;  // (2^9 - 1) / 2^9 * 2^(31 - 15)
+    r = clamp(r, 0.0f, maxValue);
+    g = clamp(g, 0.0f, maxValue);
+    b = clamp(b, 0.0f, maxValue);
+    float maxChannel = std::max({r, g, b});
+    int exponent = 0;
+    std::frexp(maxChannel, &exponent);  // maxChannel = m * 2^exponent, m in [0.5, 1)
+    int shared = std::max(-bias - 1, exponent - 1) + 1 + bias;
+    float scale = std::ldexp(1.0f, shared - bias - mantissaBits);
+    if (static_cast<int>(std::floor(maxChannel / scale + 0.5f)) == (1 << mantissaBits)) {
+        scale *= 2.0f;
+        ++shared;
+    }
+    GLuint rm = static_cast<GLuint>(std::floor(r / scale + 0.5f));
+    GLuint gm = static_cast<GLuint>(std::floor(g / scale + 0.5f));
+    GLuint bm = static_cast<GLuint>(std::floor(b / scale + 0.5f));
+    return rm | (gm << 9) | (bm << 18) | (static_cast<GLuint>(shared) << 27);
+}
+
+static GLuint packSnorm2101010(float x, float y, float z) {
+    auto pack10 = [](float v) {
+        int32_t i = static_cast<int32_t>(std::lround(clamp(v, -1.0f, 1.0f) * 511.0f));
+        return static_cast<GLuint>(i) & 0x3FFu;
+    };
+    return pack10(x) | (pack10(y) << 10) | (pack10(z) << 20);
+}
+
+// Collapse a non-indexed triangle list into unique vertices plus indices.
+// Vertices are merged only when every attribute matches bit-for-bit.
+static MeshData buildIndexedMesh(const float* triangleVertices, size_t vertexCount, int floatsPerVertex) {
+    MeshData mesh;
+    mesh.floatsPerVertex = floatsPerVertex;
+    mesh.indices.reserve(vertexCount);
+
+    const size_t vertexBytes = static_cast<size_t>(floatsPerVertex) * sizeof(float);
+    std::unordered_map<std::string, GLushort> uniqueVertices;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const float* vertex = triangleVertices + i * floatsPerVertex;
+        std::string key(reinterpret_cast<const char*>(vertex), vertexBytes);
+        auto it = uniqueVertices.find(key);
+        if (it != uniqueVertices.end()) {
+            mesh.indices.push_back(it->second);
+            continue;
+        }
+        size_t newIndex = mesh.vertices.size() / floatsPerVertex;
+        if (newIndex > 0xFFFF) {
+            std::cerr << "Mesh has more unique vertices than 16-bit indices can address" << std::endl;
+            break;
+        }
+        mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + floatsPerVertex);
+        uniqueVertices.emplace(std::move(key), static_cast<GLushort>(newIndex));
+        mesh.indices.push_back(static_cast<GLushort>(newIndex));
+    }
+    return mesh;
+}
+
+// Where one level of detail lives inside a shared vertex/index buffer
+struct MeshLod {
+    GLsizei indexCount;
+    GLsizei firstIndex;
+    GLint baseVertex;
+};
+
+// Convert a position/normal/texcoord mesh (8 floats per vertex) to the packed layout
+static std::vector<PackedVertex> packMeshVertices(const MeshData& mesh) {
+    std::vector<PackedVertex> packed(mesh.vertices.size() / 8);
+    for (size_t i = 0; i < packed.size(); ++i) {
+        const float* v = &mesh.vertices[i * 8];
+        packed[i].position[0] = floatToHalf(v[0]);
+        packed[i].position[1] = floatToHalf(v[1]);
+        packed[i].position[2] = floatToHalf(v[2]);
+        packed[i].position[3] = floatToHalf(1.0f);
+        packed[i].normal = packSnorm2101010(v[3], v[4], v[5]);
+        packed[i].texCoord[0] = static_cast<GLushort>(std::lround(clamp(v[6], 0.0f, 1.0f) * 65535.0f));
+        packed[i].texCoord[1] = static_cast<GLushort>(std::lround(clamp(v[7], 0.0f, 1.0f) * 65535.0f));
+    }
+    return packed;
+}
+
+// Bind the PackedVertex layout (attributes 0-2) to the currently bound VAO and VBO
+static void setPackedVertexAttributes() {
+    glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoord));
+    glEnableVertexAttribArray(2);
+}
+
+// Upload already-packed vertices and indices (e.g. straight from a mapped scene file)
+// into a new VAO/VBO/EBO without touching individual elements
+static void uploadPackedMesh(const PackedVertex* vertices, size_t vertexCount, const GLushort* indices,
+                             size_t indexCount, GLuint& vao, GLuint& vbo, GLuint& ebo) {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), vertices, GL_STATIC_DRAW);
+    setPackedVertexAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indices, GL_STATIC_DRAW);
+}
+
+// Upload an indexed mesh into a new VAO/VBO/EBO. Meshes with 8 floats per vertex get
+// position/normal/texcoord attributes (optionally packed); 3-float meshes get position only.
+static void uploadMesh(const MeshData& mesh, bool packed, GLuint& vao, GLuint& vbo, GLuint& ebo) {
+    if (mesh.floatsPerVertex == 8 && packed) {
+        std::vector<PackedVertex> packedVertices = packMeshVertices(mesh);
+        uploadPackedMesh(packedVertices.data(), packedVertices.size(), mesh.indices.data(), mesh.indices.size(), vao, vbo, ebo);
+        return;
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLsizei stride = mesh.floatsPerVertex * sizeof(float);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float), mesh.vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    if (mesh.floatsPerVertex == 8) {
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLushort), mesh.indices.data(), GL_STATIC_DRAW);
+}
+
 static bool sphereAabbCollision(const Vec3& center, float radius, const Vec3& min, const Vec3& max) {
     float x = clamp(center.x, min.x, max.x);
     float y = clamp(center.y, min.y, max.y);
@@ -164,24 +789,4101 @@ static bool sphereAabbCollision(const Vec3& center, float radius, const Vec3& mi
     return dot(diff, diff) < (radius * radius);
 }
 
-static float lastX = 400.0f;
-static float lastY = 300.0f;
-static bool firstMouse = true;
-static float yaw = -90.0f;
-static float pitch = 0.0f;
-static Vec3 cameraPos{0.0f, 0.6f, 4.0f};  // Start at ground + playerHeight
-static Vec3 cameraFront{0.0f, 0.0f, -1.0f};
-static Vec3 cameraUp{0.0f, 1.0f, 0.0f};
-static float deltaTime = 0.0f;
-static float lastFrame = 0.0f;
+struct Aabb {
+    Vec3 min;
+    Vec3 max;
+};
 
-// Player physics
-static float velocityY = 0.0f;           // Vertical velocity
-static const float gravity = -20.0f;     // Gravity acceleration
-static const float jumpSpeed = 8.0f;     // Initial jump velocity
-static const float playerHeight = 1.6f;  // Eye height above feet
-static const float groundLevel = -1.0f;  // Y position of ground plane
-static bool isGrounded = false;          // Is player on ground?
+// Linear allocator for data that lives for one frame (or one simulation step). Allocation
+// bumps an atomic offset into a block reserved up front, so job workers can allocate too;
+// reset() releases everything at once. Requests past capacity fall back to the heap and are
+// counted; the next reset() grows the block to the high-water mark, so memory settles after
+// the first heavy frame and steady-state frames never touch the global heap.
+struct FrameArena {
+    explicit FrameArena(size_t bytes) { grow(bytes); }
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena() { releaseOverflow(); }
+
+    void* allocate(size_t bytes, size_t alignment) {
+        size_t offset = cursor.load(std::memory_order_relaxed);
+        for (;;) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(memory.get());
+            size_t aligned = static_cast<size_t>(((base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base);
+            if (aligned + bytes > capacity) break;
+            if (cursor.compare_exchange_weak(offset, aligned + bytes, std::memory_order_relaxed)) return memory.get() + aligned;
+        }
+        // Out of space: serve from the heap for the rest of this frame
+        void* block = ::operator new(bytes, std::align_val_t(std::max(alignment, alignof(std::max_align_t))));
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflow.push_back({block, std::max(alignment, alignof(std::max_align_t))});
+        overflowBytes += bytes;
+        return block;
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    size_t used() const { return std::min(cursor.load(std::memory_order_relaxed), capacity) + overflowBytes; }
+
+    void reset() {
+        size_t frameBytes = used();
+        highWater = std::max(highWater, frameBytes);
+        if (!overflow.empty()) {
+            ++overflowFrames;
+            releaseOverflow();
+            grow(highWater + highWater / 4);
+        }
+        cursor.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity = 0;
+    size_t highWater = 0;       // Most bytes any single frame needed
+    uint32_t overflowFrames = 0;  // Frames that spilled to the heap (and grew the block)
+
+private:
+    struct Overflow {
+        void* block;
+        size_t alignment;
+    };
+
+    void grow(size_t bytes) {
+        // 64-byte aligned so cache-line sized data can be carved out of it directly
+        memory.reset(static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(64))));
+        capacity = bytes;
+    }
+
+    void releaseOverflow() {
+        for (const Overflow& o : overflow) ::operator delete(o.block, std::align_val_t(o.alignment));
+        overflow.clear();
+        overflowBytes = 0;
+    }
+
+    struct AlignedDelete {
+        void operator()(unsigned char* p) const { ::operator delete(p, std::align_val_t(64)); }
+    };
+    std::unique_ptr<unsigned char, AlignedDelete> memory;
+    std::atomic<size_t> cursor{0};
+    std::mutex overflowMutex;
+    std::vector<Overflow> overflow;
+    size_t overflowBytes = 0;
+};
+
+// Standard allocator over a FrameArena, so per-frame std::vectors bump-allocate. Freeing
+// is a no-op: the arena reclaims everything on reset, so containers must not outlive it.
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    FrameArena* arena;
+
+    ArenaAllocator(FrameArena& a) : arena(&a) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+// Fixed-size object pool for long-lived objects that come and go (terrain tiles, ...).
+// Objects live in blocks of blockSize that are never freed until the pool is, and freed
+// objects are recycled through a free list, so churn after warm-up never hits the heap.
+template <typename T, size_t blockSize = 64>
+struct Pool {
+    Pool() = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        if (!freeList) addBlock();
+        Node* node = freeList;
+        freeList = node->next;
+        highWater = std::max(highWater, ++live);
+        return new (node->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        Node* node = reinterpret_cast<Node*>(object);
+        node->next = freeList;
+        freeList = node;
+        --live;
+    }
+
+    size_t capacity() const { return blocks.size() * blockSize; }
+
+    size_t live = 0;
+    size_t highWater = 0;  // Most objects alive at once
+
+private:
+    union Node {
+        Node* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void addBlock() {
+        blocks.push_back(std::make_unique<Node[]>(blockSize));
+        Node* block = blocks.back().get();
+        for (size_t i = 0; i < blockSize; ++i) block[i].next = i + 1 < blockSize ? &block[i + 1] : freeList;
+        freeList = block;
+    }
+
+    std::vector<std::unique_ptr<Node[]>> blocks;
+    Node* freeList = nullptr;
+};
+
+// Streaming buffer for data that lives one frame (instance attributes, indirect commands,
+// per-frame uniform blocks). One GL buffer holds framesInFlight regions; each frame
+// sub-allocates its region front to back and fences it at endFrame(), so by the time a region
+// comes round again the GPU is normally done with it and CPU writes never wait. The buffer is
+// persistently mapped with GL_ARB_buffer_storage; otherwise allocations are written to a
+// client copy and flush() uploads them through an unsynchronized map, which the fences make
+// safe. A frame that outgrows its region moves to a buffer twice the size (the old one is
+// deleted once the frame's commands are submitted), so steady state never grows.
+struct StreamRing {
+    static const int framesInFlight = 3;
+
+    struct Allocation {
+        GLuint buffer = 0;
+        GLintptr offset = 0;
+        uint8_t* data = nullptr;  // Fill before the next allocate(): a grow uploads what came before
+    };
+
+    GLuint buffer = 0;
+    uint8_t* mapped = nullptr;          // Persistent mapping, or null
+    std::vector<uint8_t> clientMemory;  // Write target without buffer storage
+    size_t regionSize = 0;
+    size_t head = 0, flushed = 0;       // Absolute offsets into the buffer
+    int region = 0;
+    GLsync fences[framesInFlight] = {};
+    std::vector<GLuint> replaced;       // Outgrown buffers, deleted at endFrame()
+    size_t uniformAlignment = 256;
+    size_t highWater = 0;               // Most bytes one frame used
+    uint64_t stalls = 0;                // Frames whose region was still in use by the GPU
+
+    void init(size_t bytesPerFrame) {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformAlignment = std::max<size_t>(static_cast<size_t>(alignment), 16);
+        create(bytesPerFrame);
+    }
+
+    // Grow ahead of time (e.g. once the scene size is known) instead of on the first heavy frame
+    void reserve(size_t bytesPerFrame) {
+        if (bytesPerFrame > regionSize) create(bytesPerFrame);
+    }
+
+    void beginFrame() {
+        if (GLsync& fence = fences[region]) {
+            if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+                ++stalls;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED) {
+                }
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        head = flushed = static_cast<size_t>(region) * regionSize;
+    }
+
+    Allocation allocate(size_t bytes, size_t alignment = 16) {
+        size_t regionStart = static_cast<size_t>(region) * regionSize;
+        size_t offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + bytes > regionStart + regionSize) {
+            flush();
+            create(std::max(regionSize * 2, (head - regionStart) + bytes + alignment));
+            regionStart = static_cast<size_t>(region) * regionSize;
+            offset = (head + alignment - 1) / alignment * alignment;
+        }
+        head = offset + bytes;
+        highWater = std::max(highWater, head - regionStart);
+        return {buffer, static_cast<GLintptr>(offset), (mapped ? mapped : clientMemory.data()) + offset};
+    }
+
+    Allocation push(const void* data, size_t bytes, size_t alignment = 16) {
+        Allocation a = allocate(bytes, alignment);
+        if (bytes) std::memcpy(a.data, data, bytes);
+        return a;
+    }
+
+    // A std140 block's worth of data, bound with glBindBufferRange
+    template <typename T>
+    Allocation pushUniforms(const T& block) {
+        return push(&block, sizeof(T), uniformAlignment);
+    }
+
+    // Make everything allocated so far visible to commands issued from here on
+    void flush() {
+        if (mapped || head == flushed) return;  // Coherent mapping: nothing to do
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(flushed),
+                                        static_cast<GLsizeiptr>(head - flushed),
+                                        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (target) {
+            std::memcpy(target, clientMemory.data() + flushed, head - flushed);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        flushed = head;
+    }
+
+    // After the frame's last command that reads the region
+    void endFrame() {
+        flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (!replaced.empty()) {
+            glDeleteBuffers(static_cast<GLsizei>(replaced.size()), replaced.data());  // GL keeps them for queued commands
+            replaced.clear();
+        }
+        region = (region + 1) % framesInFlight;
+    }
+
+    void destroy() {
+        for (GLsync& fence : fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (!replaced.empty()) glDeleteBuffers(static_cast<GLsizei>(replaced.size()), replaced.data());
+        replaced.clear();
+        glDeleteBuffers(1, &buffer);  // Unmaps a persistent mapping too
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+private:
+    // Fresh buffer; the current region continues at its start. Earlier allocations this frame
+    // stay valid in the old buffer until it is deleted at endFrame().
+    void create(size_t bytesPerFrame) {
+        if (buffer) replaced.push_back(buffer);
+        for (GLsync& fence : fences) {
+            if (fence) glDeleteSync(fence);  // They guarded the old buffer
+            fence = nullptr;
+        }
+        regionSize = (bytesPerFrame + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+        size_t total = regionSize * framesInFlight;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        mapped = nullptr;
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(total), nullptr, flags);
+            mapped = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(total), flags));
+            if (!mapped) {
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            }
+        }
+        if (!mapped) {
+            glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(total), nullptr, GL_STREAM_DRAW);
+            clientMemory.assign(total, 0);
+        } else {
+            clientMemory = {};
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        head = flushed = static_cast<size_t>(region) * regionSize;
+    }
+};
+
+// Bounds how far the CPU runs ahead of the GPU. Drivers happily queue several frames,
+// each adding a frame of input latency; waiting at the top of the frame until at most
+// maxQueued earlier frames are unfinished moves that wait before input is sampled.
+struct FramePacer {
+    static constexpr int maxLimit = 3;
+    int maxQueued = -1;  // -1 = no limit (the driver's own queue depth)
+    std::deque<GLsync> fences;
+
+    void wait() {
+        if (maxQueued < 0) return;
+        while (static_cast<int>(fences.size()) > maxQueued) {
+            while (glClientWaitSync(fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(fences.front());
+            fences.pop_front();
+        }
+    }
+
+    // After the swap
+    void endFrame() {
+        if (maxQueued < 0) return;
+        fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    }
+
+    void destroy() {
+        for (GLsync fence : fences) glDeleteSync(fence);
+        fences.clear();
+    }
+};
+
+// GL's DrawElementsIndirectCommand. Instanced attributes start at baseInstance, so one
+// instance buffer serves every command of a multi-draw.
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Every static mesh packed into one vertex/index buffer pair behind one VAO, so a frame's
+// props draw without rebinding: one glMultiDrawElementsIndirect call on GL 4.3 (or
+// ARB_multi_draw_indirect + ARB_base_instance), else one instanced draw per command.
+struct MeshLibrary {
+    static const int lodCount = 2;  // Full detail, then a reduced far mesh
+    std::vector<std::array<MeshLod, lodCount>> meshes;  // Indexed by Scene::meshId
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    bool multiDraw = false;
+
+    void upload(const PackedVertex* vertices, size_t vertexCount, const GLushort* indices, size_t indexCount) {
+        uploadPackedMesh(vertices, vertexCount, indices, indexCount, vao, vbo, ebo);
+        multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+    }
+
+    const MeshLod& lod(uint16_t mesh, int level) const { return meshes[mesh][static_cast<size_t>(level)]; }
+
+    // Append one command per run of equal meshes in order[begin, end) at `level`
+    template <typename Commands>
+    void appendCommands(const uint32_t* order, size_t begin, size_t end, const uint16_t* meshIds, int level,
+                        Commands& out) const {
+        size_t run = begin;
+        while (run < end) {
+            uint16_t mesh = meshIds[order[run]];
+            size_t runEnd = run + 1;
+            while (runEnd < end && meshIds[order[runEnd]] == mesh) ++runEnd;
+            const MeshLod& range = lod(mesh, level);
+            out.push_back({static_cast<GLuint>(range.indexCount), static_cast<GLuint>(runEnd - run),
+                           static_cast<GLuint>(range.firstIndex), range.baseVertex, static_cast<GLuint>(run)});
+            run = runEnd;
+        }
+    }
+
+    // Where draw() reads per-instance data, as buffer + byte offset: model matrices
+    // (attributes 3-6) and tints (attribute 7; tintBuffer 0 = leave attribute 7 alone)
+    struct Instances {
+        GLuint matrixBuffer = 0;
+        GLintptr matrixOffset = 0;
+        GLuint tintBuffer = 0;
+        GLintptr tintOffset = 0;
+    };
+
+    // Instanced draws of `commands`; with multi-draw they are read from `indirect` at
+    // `indirectOffset` instead, so they must have been written there
+    void draw(GLuint indirect, GLintptr indirectOffset, const DrawCommand* commands, size_t count,
+              const Instances& instances) const {
+        if (count == 0) return;
+        glBindVertexArray(vao);
+        if (multiDraw) {
+            pointInstances(instances, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)indirectOffset,
+                                        static_cast<GLsizei>(count), 0);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            // No base-instance in GL 3.3: point the instance attributes at this command's range
+            const DrawCommand& command = commands[i];
+            pointInstances(instances, command.baseInstance);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_SHORT,
+                                              (void*)(command.firstIndex * sizeof(GLushort)),
+                                              static_cast<GLsizei>(command.instanceCount), command.baseVertex);
+        }
+    }
+
+    void destroy() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+    }
+
+private:
+    static void pointInstances(const Instances& instances, size_t firstInstance) {
+        glBindBuffer(GL_ARRAY_BUFFER, instances.matrixBuffer);
+        for (int col = 0; col < 4; ++col) {
+            glVertexAttribPointer(3 + col, 4, GL_FLOAT, GL_FALSE, sizeof(Mat4),
+                                  (void*)(instances.matrixOffset + firstInstance * sizeof(Mat4) + col * 4 * sizeof(float)));
+        }
+        if (instances.tintBuffer) {
+            glBindBuffer(GL_ARRAY_BUFFER, instances.tintBuffer);
+            glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3),
+                                  (void*)(instances.tintOffset + firstInstance * sizeof(Vec3)));
+        }
+    }
+};
+
+// Stable counting sort of order[0, count) by mesh id: runs of one mesh for appendCommands,
+// keeping the front-to-back order inside each mesh
+static void groupByMesh(uint32_t* order, size_t count, const uint16_t* meshIds, size_t meshCount, FrameArena& arena) {
+    if (meshCount < 2 || count < 2) return;
+    uint32_t* starts = arena.allocateArray<uint32_t>(meshCount + 1);
+    std::fill(starts, starts + meshCount + 1, 0u);
+    for (size_t i = 0; i < count; ++i) ++starts[meshIds[order[i]] + 1];
+    for (size_t m = 0; m < meshCount; ++m) starts[m + 1] += starts[m];
+    uint32_t* sorted = arena.allocateArray<uint32_t>(count);
+    for (size_t i = 0; i < count; ++i) sorted[starts[meshIds[order[i]]]++] = order[i];
+    std::copy(sorted, sorted + count, order);
+}
+
+// Uniform grid broadphase over the XZ plane. Each cell lists the ids of the
+// objects whose AABB overlaps it; queries only visit cells a box touches.
+struct SpatialGrid {
+    float cellSize = 2.0f;
+    std::unordered_map<int64_t, std::vector<uint32_t>> cells;
+    std::vector<uint32_t> queryStamps;  // Per-id marker to report each id once per query
+    uint32_t currentStamp = 0;
+
+    struct CellRange {
+        int minX, minZ, maxX, maxZ;
+        bool operator==(const CellRange& o) const {
+            return minX == o.minX && minZ == o.minZ && maxX == o.maxX && maxZ == o.maxZ;
+        }
+    };
+
+    static int64_t cellKey(int x, int z) {
+        return (static_cast<int64_t>(x) << 32) ^ static_cast<int64_t>(static_cast<uint32_t>(z));
+    }
+
+    CellRange cellRange(const Aabb& box) const {
+        return {static_cast<int>(std::floor(box.min.x / cellSize)), static_cast<int>(std::floor(box.min.z / cellSize)),
+                static_cast<int>(std::floor(box.max.x / cellSize)), static_cast<int>(std::floor(box.max.z / cellSize))};
+    }
+
+    void insert(uint32_t id, const Aabb& box) {
+        if (id >= queryStamps.size()) queryStamps.resize(id + 1, 0);
+        CellRange r = cellRange(box);
+        for (int z = r.minZ; z <= r.maxZ; ++z)
+            for (int x = r.minX; x <= r.maxX; ++x)
+                cells[cellKey(x, z)].push_back(id);
+    }
+
+    void remove(uint32_t id, const Aabb& box) {
+        CellRange r = cellRange(box);
+        for (int z = r.minZ; z <= r.maxZ; ++z) {
+            for (int x = r.minX; x <= r.maxX; ++x) {
+                auto it = cells.find(cellKey(x, z));
+                if (it == cells.end()) continue;
+                std::vector<uint32_t>& ids = it->second;
+                auto found = std::find(ids.begin(), ids.end(), id);
+                if (found != ids.end()) {
+                    *found = ids.back();
+                    ids.pop_back();
+                }
+                if (ids.empty()) cells.erase(it);
+            }
+        }
+    }
+
+    // Re-bucket an object that moved; a no-op while it stays within the same cells
+    void update(uint32_t id, const Aabb& oldBox, const Aabb& newBox) {
+        if (cellRange(oldBox) == cellRange(newBox)) return;
+        remove(id, oldBox);
+        insert(id, newBox);
+    }
+
+    // Append the ids of every object sharing a cell with the box (candidates, not hits)
+    template <typename Ids>
+    void query(const Aabb& box, Ids& out) {
+        if (++currentStamp == 0) {
+            std::fill(queryStamps.begin(), queryStamps.end(), 0);
+            currentStamp = 1;
+        }
+        CellRange r = cellRange(box);
+        for (int z = r.minZ; z <= r.maxZ; ++z) {
+            for (int x = r.minX; x <= r.maxX; ++x) {
+                auto it = cells.find(cellKey(x, z));
+                if (it == cells.end()) continue;
+                for (uint32_t id : it->second) {
+                    if (queryStamps[id] == currentStamp) continue;
+                    queryStamps[id] = currentStamp;
+                    out.push_back(id);
+                }
+            }
+        }
+    }
+};
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance)
+struct Frustum {
+    float planes[6][4];
+};
+
+enum class CullResult { Outside, Intersects, Inside };
+
+// Gribb-Hartmann plane extraction from a combined projection * view matrix
+static Frustum extractFrustum(const Mat4& viewProjection) {
+    const float* m = viewProjection.m;
+    // Row i of the (column-major) clip matrix is m[i], m[4 + i], m[8 + i], m[12 + i]
+    auto row = [m](int i, float sign, float out[4]) {
+        out[0] = m[3] + sign * m[i];
+        out[1] = m[7] + sign * m[4 + i];
+        out[2] = m[11] + sign * m[8 + i];
+        out[3] = m[15] + sign * m[12 + i];
+        float len = std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+        if (len > 0.0f) {
+            for (int k = 0; k < 4; ++k) out[k] /= len;
+        }
+    };
+    Frustum f{};
+    row(0, 1.0f, f.planes[0]);   // Left
+    row(0, -1.0f, f.planes[1]);  // Right
+    row(1, 1.0f, f.planes[2]);   // Bottom
+    row(1, -1.0f, f.planes[3]);  // Top
+    row(2, 1.0f, f.planes[4]);   // Near
+    row(2, -1.0f, f.planes[5]);  // Far
+    return f;
+}
+
+static CullResult cullAabb(const Frustum& frustum, const Aabb& box) {
+    CullResult result = CullResult::Inside;
+    for (const auto& p : frustum.planes) {
+        // Corner furthest along the plane normal decides "outside"; the nearest one decides "inside"
+        float px = p[0] >= 0.0f ? box.max.x : box.min.x;
+        float py = p[1] >= 0.0f ? box.max.y : box.min.y;
+        float pz = p[2] >= 0.0f ? box.max.z : box.min.z;
+        if (p[0] * px + p[1] * py + p[2] * pz + p[3] < 0.0f) return CullResult::Outside;
+        float nx = p[0] >= 0.0f ? box.min.x : box.max.x;
+        float ny = p[1] >= 0.0f ? box.min.y : box.max.y;
+        float nz = p[2] >= 0.0f ? box.min.z : box.max.z;
+        if (p[0] * nx + p[1] * ny + p[2] * nz + p[3] < 0.0f) result = CullResult::Intersects;
+    }
+    return result;
+}
+
+static Aabb mergeAabb(const Aabb& a, const Aabb& b) {
+    return {{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)},
+            {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)}};
+}
+
+// Bounding volume hierarchy over object AABBs. Interior nodes store their two
+// children at [first, first + 1]; leaves store a run of objectIds at [first, first + count).
+struct Bvh {
+    struct Node {
+        Aabb bounds;
+        uint32_t first = 0;
+        uint32_t count = 0;  // 0 for interior nodes
+    };
+
+    static const uint32_t maxLeafSize = 4;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> objectIds;
+
+    void build(const std::vector<Aabb>& objectBounds) {
+        nodes.clear();
+        objectIds.resize(objectBounds.size());
+        for (size_t i = 0; i < objectIds.size(); ++i) objectIds[i] = static_cast<uint32_t>(i);
+        if (objectIds.empty()) return;
+        nodes.reserve(objectIds.size() * 2);
+        nodes.push_back({});
+        buildNode(0, 0, static_cast<uint32_t>(objectIds.size()), objectBounds);
+    }
+
+    // Top-down median split along the longest axis of the centroid bounds
+    void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<Aabb>& objectBounds) {
+        Aabb bounds = objectBounds[objectIds[begin]];
+        Aabb centroids{centroid(bounds), centroid(bounds)};
+        for (uint32_t i = begin + 1; i < end; ++i) {
+            const Aabb& b = objectBounds[objectIds[i]];
+            bounds = mergeAabb(bounds, b);
+            Vec3 c = centroid(b);
+            centroids = mergeAabb(centroids, {c, c});
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        if (end - begin <= maxLeafSize) {
+            nodes[nodeIndex].first = begin;
+            nodes[nodeIndex].count = end - begin;
+            return;
+        }
+
+        Vec3 extent = sub(centroids.max, centroids.min);
+        int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+        auto axisValue = [axis](const Vec3& v) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); };
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(objectIds.begin() + begin, objectIds.begin() + mid, objectIds.begin() + end,
+                         [&](uint32_t a, uint32_t b) {
+                             return axisValue(centroid(objectBounds[a])) < axisValue(centroid(objectBounds[b]));
+                         });
+
+        uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({});
+        nodes.push_back({});
+        nodes[nodeIndex].first = leftIndex;
+        nodes[nodeIndex].count = 0;
+        buildNode(leftIndex, begin, mid, objectBounds);
+        buildNode(leftIndex + 1, mid, end, objectBounds);
+    }
+
+    static Vec3 centroid(const Aabb& b) { return mul(add(b.min, b.max), 0.5f); }
+
+    // Append every object whose node intersects the frustum. Subtrees fully inside
+    // are accepted without testing their children.
+    template <typename Ids>
+    void cull(const Frustum& frustum, const std::vector<Aabb>& objectBounds, Ids& visible, uint32_t root = 0) const {
+        if (nodes.empty()) return;
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            CullResult r = cullAabb(frustum, node.bounds);
+            if (r == CullResult::Outside) continue;
+            if (r == CullResult::Inside) {
+                appendSubtree(node, visible);
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (cullAabb(frustum, objectBounds[objectIds[i]]) != CullResult::Outside) visible.push_back(objectIds[i]);
+                }
+            } else {
+                // Push right first so subtrees are emitted left to right
+                stack[top++] = node.first + 1;
+                stack[top++] = node.first;
+            }
+        }
+    }
+
+    // Breadth-first cut of the tree into at least `target` disjoint subtrees (fewer if
+    // the tree runs out of interior nodes), in left-to-right order
+    template <typename Ids>
+    void splitFrontier(size_t target, Ids& frontier) const {
+        frontier.clear();
+        if (nodes.empty()) return;
+        frontier.push_back(0);
+        bool expanded = true;
+        while (frontier.size() < target && expanded) {
+            expanded = false;
+            Ids next(frontier.get_allocator());
+            next.reserve(frontier.size() * 2);
+            for (uint32_t n : frontier) {
+                if (nodes[n].count == 0) {
+                    next.push_back(nodes[n].first);
+                    next.push_back(nodes[n].first + 1);
+                    expanded = true;
+                } else {
+                    next.push_back(n);
+                }
+            }
+            frontier.swap(next);
+        }
+    }
+
+    // Objects under a node: subtrees cover a contiguous run of objectIds
+    size_t subtreeSize(uint32_t root) const {
+        const Node* first = &nodes[root];
+        while (first->count == 0) first = &nodes[first->first];
+        const Node* last = &nodes[root];
+        while (last->count == 0) last = &nodes[last->first + 1];
+        return last->first + last->count - first->first;
+    }
+
+    template <typename Ids>
+    void appendSubtree(const Node& root, Ids& visible) const {
+        uint32_t stack[64];
+        int top = 0;
+        const Node* node = &root;
+        for (;;) {
+            if (node->count > 0) {
+                visible.insert(visible.end(), objectIds.begin() + node->first, objectIds.begin() + node->first + node->count);
+            } else {
+                stack[top++] = node->first + 1;
+                stack[top++] = node->first;
+            }
+            if (top == 0) break;
+            node = &nodes[stack[--top]];
+        }
+    }
+};
+
+// Countdown shared by a batch of jobs; reaches zero once every job in the batch has run
+struct JobCounter {
+    std::atomic<int> pending{0};
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Work-stealing job scheduler. Each thread owns a deque: it pushes and pops its own
+// work at the back (LIFO, cache-warm), while idle threads steal from the front of
+// other deques. Thread 0 is the main thread, which runs jobs while it waits on a
+// counter instead of blocking, so it stays free for GL submission in between.
+struct JobSystem {
+    struct Job {
+        std::function<void()> fn;
+        JobCounter* counter = nullptr;     // Decremented when the job finishes
+        JobCounter* dependency = nullptr;  // Job may not start until this reaches zero
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+    std::atomic<int> blockedJobs{0};  // Queued jobs with a dependency; finishing a job may release them
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    static int& threadIndex() {
+        static thread_local int index = 0;  // 0 = main (or any non-worker) thread
+        return index;
+    }
+
+    size_t threadCount() const { return queues.size(); }
+
+    // workerCount additional threads; 0 runs every job inline on the caller
+    void start(unsigned workerCount) {
+        queues.clear();
+        for (unsigned i = 0; i <= workerCount; ++i) queues.push_back(std::make_unique<WorkerQueue>());
+        running = true;
+        for (unsigned i = 1; i <= workerCount; ++i) {
+            threads.emplace_back([this, i] {
+                threadIndex() = static_cast<int>(i);
+                workerLoop(static_cast<int>(i));
+            });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+
+    void submit(std::function<void()> fn, JobCounter* counter, JobCounter* dependency = nullptr) {
+        if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+        if (threads.empty() && (!dependency || dependency->done())) {
+            fn();
+            if (counter) counter->pending.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        WorkerQueue& q = *queues[static_cast<size_t>(threadIndex()) % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.jobs.push_back({std::move(fn), counter, dependency});
+        }
+        if (dependency) blockedJobs.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Help run jobs until the counter reaches zero
+    void wait(const JobCounter& counter) {
+        int self = threadIndex();
+        while (!counter.done()) {
+            if (!runOne(self)) std::this_thread::yield();
+        }
+    }
+
+    // Split [0, count) into grain-sized ranges and run fn(begin, end) across all threads
+    template <typename Fn>
+    void parallelFor(size_t count, size_t grain, const Fn& fn) {
+        if (count == 0) return;
+        if (count <= grain || threads.empty()) {
+            fn(size_t(0), count);
+            return;
+        }
+        JobCounter counter;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = std::min(count, begin + grain);
+            submit([&fn, begin, end] { fn(begin, end); }, &counter);
+        }
+        wait(counter);
+    }
+
+    bool tryPop(int self, Job& out) {
+        size_t n = queues.size();
+        for (size_t k = 0; k < n; ++k) {
+            size_t victim = (static_cast<size_t>(self) + k) % n;
+            WorkerQueue& q = *queues[victim];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.jobs.empty()) continue;
+            // Own queue: newest first; other queues: steal the oldest
+            auto takeAt = [&](std::deque<Job>::iterator it) {
+                out = std::move(*it);
+                q.jobs.erase(it);
+                return true;
+            };
+            if (k == 0) {
+                for (auto it = q.jobs.end(); it != q.jobs.begin();) {
+                    --it;
+                    if (!it->dependency || it->dependency->done()) return takeAt(it);
+                }
+            } else {
+                for (auto it = q.jobs.begin(); it != q.jobs.end(); ++it) {
+                    if (!it->dependency || it->dependency->done()) return takeAt(it);
+                }
+            }
+        }
+        return false;
+    }
+
+    // Whether any queue holds a job that could start now (sleeping workers re-check this)
+    bool hasRunnable() {
+        for (auto& queue : queues) {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            for (const Job& job : queue->jobs) {
+                if (!job.dependency || job.dependency->done()) return true;
+            }
+        }
+        return false;
+    }
+
+    bool runOne(int self) {
+        Job job;
+        if (!tryPop(self, job)) return false;
+        if (job.dependency) blockedJobs.fetch_sub(1);
+        job.fn();
+        // A counter reaching zero may release dependent jobs that no submit() will announce
+        if (job.counter && job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+            blockedJobs.load() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+        }
+        return true;
+    }
+
+    // Sleep until a runnable job is queued; jobs blocked on a dependency don't keep workers
+    // spinning, they are woken when a finished job releases them
+    void workerLoop(int self) {
+        while (running) {
+            if (runOne(self)) continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return !running || hasRunnable(); });
+        }
+    }
+};
+
+// Frustum-cull the BVH with one job per subtree; output is in the same order as a serial cull.
+// Per-subtree lists come from the frame arena, sized up front so workers never allocate.
+static void cullParallel(const Bvh& bvh, const Frustum& frustum, const std::vector<Aabb>& objectBounds,
+                         FrameVector<uint32_t>& visible, JobSystem& jobs, FrameArena& arena) {
+    const size_t minObjectsForJobs = 4096;
+    if (jobs.threadCount() <= 1 || objectBounds.size() < minObjectsForJobs) {
+        bvh.cull(frustum, objectBounds, visible);
+        return;
+    }
+    FrameVector<uint32_t> frontier(arena);
+    bvh.splitFrontier(jobs.threadCount() * 4, frontier);
+    FrameVector<FrameVector<uint32_t>> partial(frontier.size(), FrameVector<uint32_t>(arena), arena);
+    for (size_t i = 0; i < frontier.size(); ++i) partial[i].reserve(bvh.subtreeSize(frontier[i]));
+    jobs.parallelFor(frontier.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) bvh.cull(frustum, objectBounds, partial[i], frontier[i]);
+    });
+    for (const auto& part : partial) visible.insert(visible.end(), part.begin(), part.end());
+}
+
+// Procedural sky description. Every field feeds the cache key, so changing the sun
+// or palette regenerates the cubemap.
+struct SkyParams {
+    Vec3 sunDir{0.4f, 0.6f, -0.7f};           // Normalized on use
+    Vec3 horizon{1.8f, 1.4f, 0.9f};           // Warm golden horizon
+    Vec3 zenith{0.2f, 0.4f, 1.2f};            // Deep blue zenith
+    Vec3 groundHorizon{1.0f, 0.8f, 0.6f};     // Warm below-horizon band
+    Vec3 nadir{0.15f, 0.12f, 0.10f};          // Dark earth
+    Vec3 sunDisc{30.0f, 28.0f, 20.0f};        // Very bright HDR disc
+    Vec3 sunGlow{1.5f, 1.2f, 0.6f};           // Softer halo
+};
+
+// Fill one row of one cubemap face with RGB9_E5 sky radiance. The inner loop is
+// branch-free (sky and ground are blended by a 0/1 weight instead of selected, and the
+// sun powers are repeated squaring instead of std::pow) so the compiler can vectorize
+// it. `rgb` is caller-owned scratch of 3 * size floats, reused across rows.
+// Cubemap face basis: direction = origin + u * uAxis + v * vAxis (GL cubemap face order)
+static const float cubeFaceBasis[6][9] = {
+    { 1, 0, 0,   0, 0, -1,   0, -1, 0},  // +X
+    {-1, 0, 0,   0, 0,  1,   0, -1, 0},  // -X
+    { 0, 1, 0,   1, 0,  0,   0, 0,  1},  // +Y
+    { 0,-1, 0,   1, 0,  0,   0, 0, -1},  // -Y
+    { 0, 0, 1,   1, 0,  0,   0, -1, 0},  // +Z
+    { 0, 0,-1,  -1, 0,  0,   0, -1, 0},  // -Z
+};
+
+static void generateSkyRow(const SkyParams& p, int size, int face, int y, float* rgb, GLuint* out) {
+    const float* b = cubeFaceBasis[face];
+    Vec3 sun = normalize(p.sunDir);
+    float v = (y + 0.5f) / size * 2.0f - 1.0f;
+
+    for (int x = 0; x < size; ++x) {
+        float u = (x + 0.5f) / size * 2.0f - 1.0f;
+        float dx = b[0] + u * b[3] + v * b[6];
+        float dy = b[1] + u * b[4] + v * b[7];
+        float dz = b[2] + u * b[5] + v * b[8];
+        float invLen = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+        dx *= invLen; dy *= invLen; dz *= invLen;
+
+        // Sky gradient (horizon to zenith) above, ground gradient below
+        float elevation = dy;
+        float up = std::sqrt(std::max(elevation, 0.0f));
+        float down = std::min(1.0f, std::max(-elevation, 0.0f) * 2.0f);
+        float sky = static_cast<float>(elevation > 0.0f);  // 1 above the horizon, 0 below
+        float groundR = p.groundHorizon.x + (p.nadir.x - p.groundHorizon.x) * down;
+        float groundG = p.groundHorizon.y + (p.nadir.y - p.groundHorizon.y) * down;
+        float groundB = p.groundHorizon.z + (p.nadir.z - p.groundHorizon.z) * down;
+        float r = groundR + (p.horizon.x + (p.zenith.x - p.horizon.x) * up - groundR) * sky;
+        float g = groundG + (p.horizon.y + (p.zenith.y - p.horizon.y) * up - groundG) * sky;
+        float bl = groundB + (p.horizon.z + (p.zenith.z - p.horizon.z) * up - groundB) * sky;
+
+        // Sun disc (sunDot^256) and glow (sunDot^8)
+        float s1 = std::max(0.0f, dx * sun.x + dy * sun.y + dz * sun.z);
+        float s2 = s1 * s1, s4 = s2 * s2, s8 = s4 * s4;
+        float s16 = s8 * s8, s32 = s16 * s16, s64 = s32 * s32, s128 = s64 * s64, s256 = s128 * s128;
+        rgb[x * 3 + 0] = r + s256 * p.sunDisc.x + s8 * p.sunGlow.x;
+        rgb[x * 3 + 1] = g + s256 * p.sunDisc.y + s8 * p.sunGlow.y;
+        rgb[x * 3 + 2] = bl + s256 * p.sunDisc.z + s8 * p.sunGlow.z;
+    }
+    for (int x = 0; x < size; ++x) out[x] = packRgb9e5(rgb[x * 3], rgb[x * 3 + 1], rgb[x * 3 + 2]);
+}
+
+// On-disk sky cache: header followed by six faces of RGB9_E5 texels in GL face order
+struct SkyCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t paramsHash;
+};
+
+static const uint32_t skyCacheVersion = 2;
+
+static uint64_t skyParamsHash(const SkyParams& params, int size) {
+    uint64_t hash = fnv1a(&params, sizeof(params));
+    hash = fnv1a(&size, sizeof(size), hash);
+    return fnv1a(&skyCacheVersion, sizeof(skyCacheVersion), hash);
+}
+
+// `kind` names what is derived from the sky ("rgb9e5" for the cubemap itself)
+static std::string skyCacheFile(const SkyParams& params, int size, const char* kind) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "cache/sky_%016llx.%s",
+                  static_cast<unsigned long long>(skyParamsHash(params, size)), kind);
+    return name;
+}
+
+// Load `words` 32-bit words cached for this sky
+static bool loadSkyCache(const std::string& path, const SkyParams& params, int size, size_t words,
+                         std::vector<GLuint>& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    SkyCacheHeader header{};
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, "OWSK", 4) != 0 || header.version != skyCacheVersion ||
+        header.size != static_cast<uint32_t>(size) || header.paramsHash != skyParamsHash(params, size)) {
+        return false;
+    }
+    data.resize(words);
+    in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(GLuint)));
+    return static_cast<bool>(in);
+}
+
+static void saveSkyCache(const std::string& path, const SkyParams& params, int size, const std::vector<GLuint>& data) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not write sky cache " << path << std::endl;
+        return;
+    }
+    SkyCacheHeader header{{'O', 'W', 'S', 'K'}, skyCacheVersion, static_cast<uint32_t>(size), 0, skyParamsHash(params, size)};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(GLuint)));
+}
+
+static void unpackRgb9e5(GLuint texel, float* rgb) {
+    float scale = std::ldexp(1.0f, static_cast<int>(texel >> 27) - 15 - 9);
+    rgb[0] = static_cast<float>(texel & 0x1FFu) * scale;
+    rgb[1] = static_cast<float>((texel >> 9) & 0x1FFu) * scale;
+    rgb[2] = static_cast<float>((texel >> 18) & 0x1FFu) * scale;
+}
+
+// Unit direction through the centre of a cubemap texel
+static Vec3 cubeTexelDirection(int face, int size, int x, int y) {
+    const float* b = cubeFaceBasis[face];
+    float u = (x + 0.5f) / size * 2.0f - 1.0f;
+    float v = (y + 0.5f) / size * 2.0f - 1.0f;
+    return normalize({b[0] + u * b[3] + v * b[6], b[1] + u * b[4] + v * b[7], b[2] + u * b[5] + v * b[8]});
+}
+
+// Solid angle a cubemap texel subtends (texels near face corners cover less of the sphere)
+static float cubeTexelSolidAngle(int size, int x, int y) {
+    float u = (x + 0.5f) / size * 2.0f - 1.0f;
+    float v = (y + 0.5f) / size * 2.0f - 1.0f;
+    float texel = 2.0f / size;
+    return texel * texel / std::pow(1.0f + u * u + v * v, 1.5f);
+}
+
+// Lighting terms derived from the sky cubemap so shading never samples the full-size sky:
+// - ambient: cosine-convolved irradiance as 9 spherical-harmonic coefficients, divided by
+//   pi and pre-multiplied by the SH basis constants, so the shader's evaluation is nine
+//   MADs on the normal (the result is cosine-weighted average radiance)
+// - reflections: a small cubemap whose mip k holds the sky convolved with a Phong lobe of
+//   exponent 4^(6 - k), so a reflection of a given glossiness is one textureLod
+struct SkyLighting {
+    static const int specularSize = 64;
+    static const int specularLevels = 7;  // 64x64 down to 1x1
+    Vec3 irradianceSH[9]{};
+    std::vector<GLuint> specular;  // RGB9_E5: level by level, six faces per level in GL order
+
+    static size_t specularTexels() {
+        size_t texels = 0;
+        for (int level = 0; level < specularLevels; ++level) texels += static_cast<size_t>(6) * (specularSize >> level) * (specularSize >> level);
+        return texels;
+    }
+
+    static float lobeExponent(int level) { return std::ldexp(1.0f, 2 * (specularLevels - 1 - level)); }
+
+    // Cache layout: 27 floats of SH followed by the specular mip chain
+    std::vector<GLuint> serialize() const {
+        std::vector<GLuint> words(27);
+        std::memcpy(words.data(), irradianceSH, sizeof(irradianceSH));
+        words.insert(words.end(), specular.begin(), specular.end());
+        return words;
+    }
+
+    void deserialize(const std::vector<GLuint>& words) {
+        std::memcpy(irradianceSH, words.data(), sizeof(irradianceSH));
+        specular.assign(words.begin() + 27, words.end());
+    }
+};
+
+// Derive SkyLighting from an RGB9_E5 sky cubemap (power-of-two faces of at least
+// specularSize) on the job system
+static void computeSkyLighting(const std::vector<GLuint>& sky, int size, JobSystem& jobs, SkyLighting& out) {
+    const size_t rows = static_cast<size_t>(6) * size;
+    std::vector<float> radiance(sky.size() * 3);
+    jobs.parallelFor(sky.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) unpackRgb9e5(sky[i], &radiance[i * 3]);
+    });
+
+    // SH9 projection, one partial sum per face row
+    std::vector<float> partial(rows * 27, 0.0f);
+    jobs.parallelFor(rows, 16, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            int face = static_cast<int>(row / size), y = static_cast<int>(row % size);
+            float* sum = &partial[row * 27];
+            for (int x = 0; x < size; ++x) {
+                Vec3 d = cubeTexelDirection(face, size, x, y);
+                float w = cubeTexelSolidAngle(size, x, y);
+                const float basis[9] = {1.0f, d.y, d.z, d.x, d.x * d.y, d.y * d.z, 3.0f * d.z * d.z - 1.0f, d.x * d.z, d.x * d.x - d.y * d.y};
+                const float* L = &radiance[(row * size + x) * 3];
+                for (int k = 0; k < 9; ++k) {
+                    for (int c = 0; c < 3; ++c) sum[k * 3 + c] += L[c] * basis[k] * w;
+                }
+            }
+        }
+    });
+    // Basis constants appear twice (projection and evaluation); band l is convolved by A_l / pi
+    const float basisConstant[9] = {0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f};
+    const float bandScale[9] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+    for (int k = 0; k < 9; ++k) {
+        double total[3] = {0.0, 0.0, 0.0};
+        for (size_t row = 0; row < rows; ++row) {
+            for (int c = 0; c < 3; ++c) total[c] += partial[row * 27 + k * 3 + c];
+        }
+        float scale = basisConstant[k] * basisConstant[k] * bandScale[k];
+        out.irradianceSH[k] = {static_cast<float>(total[0]) * scale, static_cast<float>(total[1]) * scale,
+                               static_cast<float>(total[2]) * scale};
+    }
+
+    // Box-filtered pyramid down to 8x8 faces; each specular level integrates the pyramid
+    // level of its own size (8x8 for the tiny ones), which is enough for its lobe width
+    std::vector<std::vector<float>> pyramid;  // pyramid[i] has faces of (specularSize >> i)
+    std::vector<float> current = std::move(radiance);
+    for (int s = size; s > 8; s /= 2) {
+        if (s <= SkyLighting::specularSize) pyramid.push_back(current);
+        int half = s / 2;
+        std::vector<float> next(static_cast<size_t>(6) * half * half * 3);
+        for (int face = 0; face < 6; ++face) {
+            for (int y = 0; y < half; ++y) {
+                for (int x = 0; x < half; ++x) {
+                    for (int c = 0; c < 3; ++c) {
+                        auto at = [&](int sx, int sy) { return current[((static_cast<size_t>(face) * s + sy) * s + sx) * 3 + c]; };
+                        next[((static_cast<size_t>(face) * half + y) * half + x) * 3 + c] =
+                            0.25f * (at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1));
+                    }
+                }
+            }
+        }
+        current.swap(next);
+    }
+    pyramid.push_back(current);  // 8x8
+
+    out.specular.resize(SkyLighting::specularTexels());
+    size_t levelOffset = 0;
+    for (int level = 0; level < SkyLighting::specularLevels; ++level) {
+        int s = SkyLighting::specularSize >> level;
+        size_t texels = static_cast<size_t>(6) * s * s;
+        GLuint* dst = &out.specular[levelOffset];
+        levelOffset += texels;
+        if (level == 0) {
+            for (size_t i = 0; i < texels; ++i) dst[i] = packRgb9e5(pyramid[0][i * 3], pyramid[0][i * 3 + 1], pyramid[0][i * 3 + 2]);
+            continue;
+        }
+        int sourceLevel = std::min(level, static_cast<int>(pyramid.size()) - 1);
+        int srcSize = SkyLighting::specularSize >> sourceLevel;
+        const std::vector<float>& src = pyramid[static_cast<size_t>(sourceLevel)];
+        std::vector<Vec3> srcDir(static_cast<size_t>(6) * srcSize * srcSize);
+        std::vector<float> srcWeight(srcDir.size());
+        for (int face = 0; face < 6; ++face) {
+            for (int y = 0; y < srcSize; ++y) {
+                for (int x = 0; x < srcSize; ++x) {
+                    size_t i = (static_cast<size_t>(face) * srcSize + y) * srcSize + x;
+                    srcDir[i] = cubeTexelDirection(face, srcSize, x, y);
+                    srcWeight[i] = cubeTexelSolidAngle(srcSize, x, y);
+                }
+            }
+        }
+        float exponent = SkyLighting::lobeExponent(level);
+        float cutoff = std::pow(1e-3f, 1.0f / exponent);  // Lobe below 0.1% of its peak is skipped
+        jobs.parallelFor(texels, 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                int face = static_cast<int>(i / (static_cast<size_t>(s) * s));
+                int y = static_cast<int>(i / s % s), x = static_cast<int>(i % s);
+                Vec3 d = cubeTexelDirection(face, s, x, y);
+                float sum[3] = {0.0f, 0.0f, 0.0f};
+                float weight = 0.0f;
+                for (size_t j = 0; j < srcDir.size(); ++j) {
+                    float c = dot(d, srcDir[j]);
+                    if (c <= cutoff) continue;
+                    float w = std::pow(c, exponent) * srcWeight[j];
+                    for (int k = 0; k < 3; ++k) sum[k] += src[j * 3 + k] * w;
+                    weight += w;
+                }
+                dst[i] = packRgb9e5(sum[0] / weight, sum[1] / weight, sum[2] / weight);
+            }
+        });
+    }
+}
+
+// Stable reference to a scene object. Remains valid (and detectably stale once the
+// object is destroyed) while other objects are created and removed.
+struct ObjectHandle {
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+};
+
+// Structure-of-arrays scene store. Every column is indexed by the same dense object
+// index, so systems stream only the columns they need. Removal swaps the last object
+// into the hole; handles go through the slot table to find an object's dense index.
+struct Scene {
+    std::vector<Vec3> position;
+    std::vector<Vec3> rotation;    // Euler radians, applied Z, then X, then Y
+    std::vector<Vec3> scale;
+    std::vector<Vec3> tint;
+    std::vector<Aabb> bounds;      // World AABB enclosing the object under any rotation (culling)
+    std::vector<Aabb> collider;    // World collision box
+    std::vector<uint16_t> meshId;
+    std::vector<uint32_t> slotOf;  // Dense index -> handle slot
+
+    struct Slot {
+        uint32_t dense = 0;
+        uint32_t generation = 0;
+        bool alive = false;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    uint32_t structureVersion = 0;  // Bumped on create/destroy so cached structures can rebuild
+
+    size_t size() const { return position.size(); }
+
+    bool alive(ObjectHandle h) const {
+        return h.slot < slots.size() && slots[h.slot].alive && slots[h.slot].generation == h.generation;
+    }
+
+    uint32_t denseIndex(ObjectHandle h) const { return slots[h.slot].dense; }
+
+    ObjectHandle create(const Vec3& pos, const Vec3& rot, const Vec3& scl, const Vec3& color,
+                        float cullExtent, float collisionExtent, uint16_t mesh) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.push_back({});
+        }
+        uint32_t dense = static_cast<uint32_t>(position.size());
+        slots[slot].dense = dense;
+        slots[slot].alive = true;
+
+        Vec3 cull{cullExtent, cullExtent, cullExtent};
+        Vec3 coll{collisionExtent, collisionExtent, collisionExtent};
+        position.push_back(pos);
+        rotation.push_back(rot);
+        scale.push_back(scl);
+        tint.push_back(color);
+        bounds.push_back({sub(pos, cull), add(pos, cull)});
+        collider.push_back({sub(pos, coll), add(pos, coll)});
+        meshId.push_back(mesh);
+        slotOf.push_back(slot);
+        ++structureVersion;
+        return {slot, slots[slot].generation};
+    }
+
+    // Bulk-append objects from matching column arrays (e.g. a mapped scene file): one copy
+    // per column instead of per-object creation; each object gets a fresh slot
+    void append(size_t count, const Vec3* pos, const Vec3* rot, const Vec3* scl, const Vec3* color,
+                const Aabb* cull, const Aabb* coll, const uint16_t* mesh) {
+        position.insert(position.end(), pos, pos + count);
+        rotation.insert(rotation.end(), rot, rot + count);
+        scale.insert(scale.end(), scl, scl + count);
+        tint.insert(tint.end(), color, color + count);
+        bounds.insert(bounds.end(), cull, cull + count);
+        collider.insert(collider.end(), coll, coll + count);
+        meshId.insert(meshId.end(), mesh, mesh + count);
+        uint32_t dense = static_cast<uint32_t>(slotOf.size());
+        uint32_t slot = static_cast<uint32_t>(slots.size());
+        slots.resize(slots.size() + count);
+        slotOf.resize(slotOf.size() + count);
+        for (size_t i = 0; i < count; ++i, ++dense, ++slot) {
+            slots[slot].dense = dense;
+            slots[slot].alive = true;
+            slotOf[dense] = slot;
+        }
+        ++structureVersion;
+    }
+
+    void destroy(ObjectHandle h) {
+        if (!alive(h)) return;
+        uint32_t dense = slots[h.slot].dense;
+        uint32_t last = static_cast<uint32_t>(position.size() - 1);
+        if (dense != last) {
+            position[dense] = position[last];
+            rotation[dense] = rotation[last];
+            scale[dense] = scale[last];
+            tint[dense] = tint[last];
+            bounds[dense] = bounds[last];
+            collider[dense] = collider[last];
+            meshId[dense] = meshId[last];
+            slotOf[dense] = slotOf[last];
+            slots[slotOf[dense]].dense = dense;
+        }
+        position.pop_back();
+        rotation.pop_back();
+        scale.pop_back();
+        tint.pop_back();
+        bounds.pop_back();
+        collider.pop_back();
+        meshId.pop_back();
+        slotOf.pop_back();
+        slots[h.slot].alive = false;
+        ++slots[h.slot].generation;
+        freeSlots.push_back(h.slot);
+        ++structureVersion;
+    }
+};
+
+// Read-only memory map of a whole file; the OS pages it in on demand, so loading costs
+// disk bandwidth rather than a parse. data stays null if the file can't be mapped.
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            close();
+            return false;
+        }
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(length.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // The mapping keeps the file referenced
+        if (view == MAP_FAILED) return false;
+        madvise(view, static_cast<size_t>(info.st_size), MADV_WILLNEED);  // Start read-ahead now
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// Binary scene file: header, section table, then 16-byte aligned sections whose payloads
+// are the exact runtime layouts (PackedVertex, GLushort indices, Scene columns), so a load
+// is mmap + bounds checks + bulk copies into GL buffers and the Scene. Little-endian only;
+// bump sceneFileVersion whenever a section layout changes.
+static const char sceneFileMagic[4] = {'O', 'W', 'S', 'C'};
+static const uint32_t sceneFileVersion = 1;
+static const uint64_t sceneSectionAlignment = 16;
+
+enum SceneSectionType : uint32_t {
+    SceneVertices = 1,  // PackedVertex[], shared by every mesh
+    SceneIndices,       // GLushort[], relative to each LOD's base vertex
+    SceneMeshLods,      // SceneMeshLod[]
+    ScenePositions,     // Object columns, objectCount entries each, in Scene order
+    SceneRotations,
+    SceneScales,
+    SceneTints,
+    SceneBounds,
+    SceneColliders,
+    SceneMeshIds,
+};
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t objectCount;
+};
+
+struct SceneFileSection {
+    uint32_t type;
+    uint32_t elementSize;  // Checked against the runtime sizeof, so layout drift is caught on load
+    uint64_t offset;       // From the start of the file
+    uint64_t count;
+};
+
+// One level of detail of one mesh inside the shared vertex/index sections
+struct SceneMeshLod {
+    uint32_t meshId;
+    uint32_t level;
+    MeshLod range;
+};
+
+static_assert(sizeof(PackedVertex) == 16 && sizeof(Vec3) == 12 && sizeof(Aabb) == 24 && sizeof(MeshLod) == 12,
+              "scene file sections mirror these layouts; bump sceneFileVersion if they change");
+
+// Typed views into a mapped scene file (pointers alias the mapping)
+struct SceneFileView {
+    const PackedVertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    const GLushort* indices = nullptr;
+    size_t indexCount = 0;
+    const SceneMeshLod* meshLods = nullptr;
+    size_t meshLodCount = 0;
+    size_t objectCount = 0;
+    const Vec3* position = nullptr;
+    const Vec3* rotation = nullptr;
+    const Vec3* scale = nullptr;
+    const Vec3* tint = nullptr;
+    const Aabb* bounds = nullptr;
+    const Aabb* collider = nullptr;
+    const uint16_t* meshId = nullptr;
+};
+
+// Validate the header and section table and point the view at each section. Sizes and
+// ranges are checked, and every index a mesh LOD draws must land inside the vertex section
+// (the GPU would otherwise read past the buffer); other payloads are used as-is. Unknown
+// sections are skipped.
+static bool parseSceneFile(const uint8_t* data, size_t size, SceneFileView& view) {
+    SceneFileHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, sceneFileMagic, 4) != 0 || header.version != sceneFileVersion) return false;
+    if (header.sectionCount > (size - sizeof(header)) / sizeof(SceneFileSection)) return false;
+
+    view = {};
+    view.objectCount = header.objectCount;
+    uint32_t seen = 0;  // Bit per section type; duplicates are rejected
+    for (uint32_t i = 0; i < header.sectionCount; ++i) {
+        SceneFileSection section;
+        std::memcpy(&section, data + sizeof(header) + i * sizeof(section), sizeof(section));
+        if (section.offset % sceneSectionAlignment != 0 || section.offset > size || section.elementSize == 0 ||
+            section.count > (size - section.offset) / section.elementSize) {
+            return false;
+        }
+        if (section.type >= SceneVertices && section.type <= SceneMeshIds) {
+            uint32_t bit = 1u << section.type;
+            if (seen & bit) return false;
+            seen |= bit;
+        }
+        const void* payload = data + section.offset;
+        auto expect = [&](size_t elementSize, bool perObject) {
+            return section.elementSize == elementSize && (!perObject || section.count == header.objectCount);
+        };
+        bool valid = true;
+        switch (section.type) {
+            case SceneVertices:
+                valid = expect(sizeof(PackedVertex), false);
+                view.vertices = static_cast<const PackedVertex*>(payload);
+                view.vertexCount = section.count;
+                break;
+            case SceneIndices:
+                valid = expect(sizeof(GLushort), false);
+                view.indices = static_cast<const GLushort*>(payload);
+                view.indexCount = section.count;
+                break;
+            case SceneMeshLods:
+                valid = expect(sizeof(SceneMeshLod), false);
+                view.meshLods = static_cast<const SceneMeshLod*>(payload);
+                view.meshLodCount = section.count;
+                break;
+            case ScenePositions: valid = expect(sizeof(Vec3), true); view.position = static_cast<const Vec3*>(payload); break;
+            case SceneRotations: valid = expect(sizeof(Vec3), true); view.rotation = static_cast<const Vec3*>(payload); break;
+            case SceneScales: valid = expect(sizeof(Vec3), true); view.scale = static_cast<const Vec3*>(payload); break;
+            case SceneTints: valid = expect(sizeof(Vec3), true); view.tint = static_cast<const Vec3*>(payload); break;
+            case SceneBounds: valid = expect(sizeof(Aabb), true); view.bounds = static_cast<const Aabb*>(payload); break;
+            case SceneColliders: valid = expect(sizeof(Aabb), true); view.collider = static_cast<const Aabb*>(payload); break;
+            case SceneMeshIds: valid = expect(sizeof(uint16_t), true); view.meshId = static_cast<const uint16_t*>(payload); break;
+            default: break;
+        }
+        if (!valid) return false;
+    }
+    uint32_t required = 1u << SceneVertices | 1u << SceneIndices;
+    for (uint32_t type = ScenePositions; type <= SceneMeshIds; ++type) required |= 1u << type;
+    if ((seen & required) != required) return false;
+    for (size_t i = 0; i < view.meshLodCount; ++i) {
+        const MeshLod& lod = view.meshLods[i].range;
+        if (lod.indexCount < 0 || lod.firstIndex < 0 || lod.baseVertex < 0 ||
+            static_cast<size_t>(lod.firstIndex) + static_cast<size_t>(lod.indexCount) > view.indexCount ||
+            static_cast<size_t>(lod.baseVertex) >= view.vertexCount) {
+            return false;
+        }
+        const GLushort* first = view.indices + lod.firstIndex;
+        const GLushort* last = first + lod.indexCount;
+        if (first != last && static_cast<size_t>(lod.baseVertex) + *std::max_element(first, last) >= view.vertexCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write a scene file from packed mesh data and a Scene, in the layout parseSceneFile maps
+static bool writeSceneFile(const std::string& path, const std::vector<PackedVertex>& vertices,
+                           const std::vector<GLushort>& indices, const std::vector<SceneMeshLod>& meshLods,
+                           const Scene& scene) {
+    struct Payload {
+        uint32_t type;
+        uint32_t elementSize;
+        size_t count;
+        const void* data;
+    };
+    const Payload payloads[] = {
+        {SceneVertices, sizeof(PackedVertex), vertices.size(), vertices.data()},
+        {SceneIndices, sizeof(GLushort), indices.size(), indices.data()},
+        {SceneMeshLods, sizeof(SceneMeshLod), meshLods.size(), meshLods.data()},
+        {ScenePositions, sizeof(Vec3), scene.size(), scene.position.data()},
+        {SceneRotations, sizeof(Vec3), scene.size(), scene.rotation.data()},
+        {SceneScales, sizeof(Vec3), scene.size(), scene.scale.data()},
+        {SceneTints, sizeof(Vec3), scene.size(), scene.tint.data()},
+        {SceneBounds, sizeof(Aabb), scene.size(), scene.bounds.data()},
+        {SceneColliders, sizeof(Aabb), scene.size(), scene.collider.data()},
+        {SceneMeshIds, sizeof(uint16_t), scene.size(), scene.meshId.data()},
+    };
+    const uint32_t sectionCount = static_cast<uint32_t>(sizeof(payloads) / sizeof(payloads[0]));
+    auto align = [](uint64_t offset) { return (offset + sceneSectionAlignment - 1) & ~(sceneSectionAlignment - 1); };
+
+    SceneFileHeader header;
+    std::memcpy(header.magic, sceneFileMagic, 4);
+    header.version = sceneFileVersion;
+    header.sectionCount = sectionCount;
+    header.objectCount = static_cast<uint32_t>(scene.size());
+    std::vector<SceneFileSection> table(sectionCount);
+    uint64_t offset = align(sizeof(header) + sectionCount * sizeof(SceneFileSection));
+    for (uint32_t i = 0; i < sectionCount; ++i) {
+        table[i] = {payloads[i].type, payloads[i].elementSize, offset, payloads[i].count};
+        offset = align(offset + payloads[i].count * payloads[i].elementSize);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), sectionCount * sizeof(SceneFileSection));
+    const char padding[sceneSectionAlignment] = {};
+    uint64_t written = sizeof(header) + sectionCount * sizeof(SceneFileSection);
+    for (uint32_t i = 0; i < sectionCount; ++i) {
+        out.write(padding, static_cast<std::streamsize>(table[i].offset - written));
+        out.write(static_cast<const char*>(payloads[i].data), static_cast<std::streamsize>(payloads[i].count * payloads[i].elementSize));
+        written = table[i].offset + payloads[i].count * payloads[i].elementSize;
+    }
+    return static_cast<bool>(out);
+}
+
+static float lastX = 400.0f;
+static float lastY = 300.0f;
+static bool firstMouse = true;
+static float yaw = -90.0f;
+static float pitch = 0.0f;
+static float pendingLookX = 0.0f;      // Mouse motion not yet applied to the camera, in degrees
+static float pendingLookY = 0.0f;
+static double pendingLookSinceMs = -1.0;  // Earliest the oldest pending motion can have arrived (-1 = none)
+static double previousPollMs = 0.0;       // Profiler time the last pollInput() finished
+static Vec3 cameraPos{0.0f, 0.6f, 4.0f};  // Rendered eye position, interpolated from the simulation
+static Vec3 cameraFront{0.0f, 0.0f, -1.0f};
+static Vec3 cameraUp{0.0f, 1.0f, 0.0f};
+static float deltaTime = 0.0f;
+static float lastFrame = 0.0f;
+
+// Player physics
+static const float gravity = -20.0f;     // Gravity acceleration
+static const float jumpSpeed = 8.0f;     // Initial jump velocity
+static const float playerHeight = 1.6f;  // Eye height above feet
+static const float groundLevel = -1.0f;  // Terrain height of the flat area around the origin
+static const float cameraSpeed = 3.0f;   // Horizontal walk speed
+static const float cameraRadius = 0.35f; // Collision sphere radius
+static const double simTimestep = 1.0 / 120.0;  // Fixed physics step (120 Hz)
+
+static double nowSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Frame profiler. CPU scopes are timed with steady_clock from any thread; GPU passes
+// are bracketed with GL_TIME_ELAPSED queries kept in a ring of gpuFramesInFlight
+// frames, so results are normally ready by the time they are read. Measured runs
+// (blockOnGpu) wait for the rare late ones; interactive runs drop and count them.
+// Time-elapsed queries cannot nest: GPU passes must be sequential within a frame.
+// Input latency runs from the earliest arrival time of the oldest input a frame consumed
+// (the poll before it) to the GPU finishing that frame, read from a GL_TIMESTAMP query
+// placed after the present pass.
+struct Profiler {
+    static const int gpuFramesInFlight = 3;
+    static const size_t overlayWindow = 240;  // Frames used for on-screen percentiles
+
+    struct Sample {
+        const char* name;
+        double startMs;     // Relative to the profiler epoch
+        double durationMs;
+        int thread;
+    };
+
+    struct Frame {
+        uint64_t index = 0;
+        double startMs = 0.0;
+        double cpuMs = 0.0;
+        double gpuMs = -1.0;  // Negative until (or unless) the timer queries resolve
+        double inputMs = -1.0;    // When the frame's oldest input event arrived (-1 = it consumed none)
+        double latencyMs = -1.0;  // inputMs to GPU completion, once resolved
+        std::vector<Sample> cpu;
+        std::vector<Sample> gpu;
+    };
+
+    struct GpuSlot {
+        uint64_t frame = 0;
+        bool pending = false;
+        std::vector<GLuint> queries;    // Grows on demand, reused every gpuFramesInFlight frames
+        std::vector<const char*> names;
+        size_t used = 0;
+        GLuint presentQuery = 0;      // GL_TIMESTAMP after the frame's last command
+        bool presentMarked = false;
+        double presentCpuMs = 0.0;    // CPU and GL clocks sampled together when it was issued
+        GLint64 presentGpuNs = 0;
+    };
+
+    double epoch = nowSeconds();
+    bool keepHistory = false;  // Retain every frame for CSV/trace output
+    std::mutex mutex;          // Guards `current` (CPU scopes can come from any thread)
+    Frame current;
+    bool currentEnded = false;  // endFrame() ran; `current` keeps taking late samples until beginFrame()
+    std::deque<Frame> awaitingGpu;
+    std::deque<Frame> history;
+    GpuSlot slots[gpuFramesInFlight];
+    uint64_t frameIndex = 0;
+    uint64_t firstKeptFrame = 0;  // Frames before this (warm-up) are retired without being kept
+    bool gpuPassOpen = false;
+    double latestGpuMs = -1.0;    // Most recently resolved GPU frame total (feeds dynamic resolution)
+    bool blockOnGpu = false;      // Wait for late timer results instead of dropping them (measured runs)
+    uint64_t droppedGpuFrames = 0;       // Kept frames whose GPU results were not ready in time
+    uint64_t droppedLatencySamples = 0;  // Kept frames with input whose present timestamp was not ready
+
+    double nowMs() const { return (nowSeconds() - epoch) * 1000.0; }
+
+    // Trace track for threads outside the job system (-1 = use the job system index)
+    static int& threadTrack() {
+        thread_local int track = -1;
+        return track;
+    }
+
+    void beginFrame() {
+        GpuSlot& slot = slots[frameIndex % gpuFramesInFlight];
+        if (slot.pending) resolve(slot);
+        slot.frame = frameIndex;
+        slot.used = 0;
+        slot.names.clear();
+        slot.pending = true;
+        slot.presentMarked = false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        handOffCurrent();
+        current = Frame{};
+        current.index = frameIndex;
+        current.startMs = nowMs();
+    }
+
+    // The frame is queued for its GPU results only at the next beginFrame(), under the same
+    // lock, so scopes other threads (the sim thread) close in between still land in it
+    void endFrame() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current.cpuMs = nowMs() - current.startMs;
+            currentEnded = true;
+        }
+        ++frameIndex;
+    }
+
+    // Caller holds `mutex`
+    void handOffCurrent() {
+        if (!currentEnded) return;
+        awaitingGpu.push_back(std::move(current));
+        currentEnded = false;
+    }
+
+    void beginGpu(const char* name) {
+        GpuSlot& slot = slots[frameIndex % gpuFramesInFlight];
+        if (slot.used == slot.queries.size()) {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        slot.names.push_back(name);
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.used++]);
+        gpuPassOpen = true;
+    }
+
+    void endGpu() {
+        if (!gpuPassOpen) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuPassOpen = false;
+    }
+
+    void markInput(double eventMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        current.inputMs = eventMs;
+    }
+
+    // After the frame's last GL command (before the swap)
+    void markPresent() {
+        GpuSlot& slot = slots[frameIndex % gpuFramesInFlight];
+        if (!slot.presentQuery) glGenQueries(1, &slot.presentQuery);
+        glQueryCounter(slot.presentQuery, GL_TIMESTAMP);
+        glGetInteger64v(GL_TIMESTAMP, &slot.presentGpuNs);
+        slot.presentCpuMs = nowMs();
+        slot.presentMarked = true;
+    }
+
+    void recordCpu(const char* name, double startMs, double durationMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int track = threadTrack() >= 0 ? threadTrack() : JobSystem::threadIndex();
+        current.cpu.push_back({name, startMs, durationMs, track});
+    }
+
+    // Collect a slot's timer results. Late ones are waited for when blockOnGpu is set, so
+    // the slowest GPU frames stay in the statistics; otherwise they are dropped and counted.
+    void resolve(GpuSlot& slot) {
+        slot.pending = false;
+        Frame* frame = nullptr;
+        for (auto& f : awaitingGpu) {
+            if (f.index == slot.frame) frame = &f;
+        }
+        if (frame) {
+            GLint available = slot.used > 0 ? 0 : 1;
+            if (slot.used > 0) glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            GLint presentAvailable = 0;
+            if (slot.presentMarked) glGetQueryObjectiv(slot.presentQuery, GL_QUERY_RESULT_AVAILABLE, &presentAvailable);
+            if (blockOnGpu) {
+                available = 1;  // GL_QUERY_RESULT below waits for the GPU
+                presentAvailable = slot.presentMarked;
+            }
+            bool kept = frame->index >= firstKeptFrame;
+            if (kept && !available) ++droppedGpuFrames;
+            if (kept && !presentAvailable && frame->inputMs >= 0.0) ++droppedLatencySamples;
+            if (presentAvailable && frame->inputMs >= 0.0) {
+                GLint64 doneNs = 0;
+                glGetQueryObjecti64v(slot.presentQuery, GL_QUERY_RESULT, &doneNs);
+                double doneMs = slot.presentCpuMs + static_cast<double>(doneNs - slot.presentGpuNs) / 1.0e6;
+                frame->latencyMs = doneMs - frame->inputMs;
+            }
+            if (available) {
+                double total = 0.0;
+                double cursor = frame->startMs;
+                for (size_t i = 0; i < slot.used; ++i) {
+                    GLuint64 ns = 0;
+                    glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+                    double ms = static_cast<double>(ns) / 1.0e6;
+                    // GPU passes are laid out back to back from the frame start in traces
+                    frame->gpu.push_back({slot.names[i], cursor, ms, -1});
+                    cursor += ms;
+                    total += ms;
+                }
+                frame->gpuMs = total;
+                latestGpuMs = total;
+            }
+        }
+        // Frames are resolved in submission order; retire everything up to this one
+        while (!awaitingGpu.empty() && awaitingGpu.front().index <= slot.frame) retireFront();
+    }
+
+    void retireFront() {
+        if (awaitingGpu.front().index >= firstKeptFrame) history.push_back(std::move(awaitingGpu.front()));
+        awaitingGpu.pop_front();
+        if (!keepHistory && history.size() > overlayWindow) history.pop_front();
+    }
+
+    // Drop everything recorded so far (e.g. shader warm-up) from the statistics
+    void discardHistory() {
+        history.clear();
+        firstKeptFrame = frameIndex;
+        droppedGpuFrames = droppedLatencySamples = 0;
+    }
+
+    // Retire frames still waiting on GPU results (at shutdown); with blockOnGpu their
+    // results are collected first, otherwise their GPU times are dropped
+    void flush() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            handOffCurrent();
+        }
+        if (blockOnGpu) {
+            for (uint64_t f = frameIndex > gpuFramesInFlight ? frameIndex - gpuFramesInFlight : 0; f < frameIndex; ++f) {
+                GpuSlot& slot = slots[f % gpuFramesInFlight];
+                if (slot.pending && slot.frame == f) resolve(slot);
+            }
+        }
+        while (!awaitingGpu.empty()) retireFront();
+    }
+
+    static double percentile(std::vector<double> values, double p) {
+        if (values.empty()) return 0.0;
+        size_t k = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+
+    struct Stats {
+        double average = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+        size_t count = 0;
+    };
+
+    static Stats stats(const std::vector<double>& values) {
+        Stats st;
+        st.count = values.size();
+        if (values.empty()) return st;
+        for (double v : values) {
+            st.average += v;
+            st.max = std::max(st.max, v);
+        }
+        st.average /= static_cast<double>(values.size());
+        st.p50 = percentile(values, 0.50);
+        st.p99 = percentile(values, 0.99);
+        return st;
+    }
+
+    // CPU and GPU frame times over the most recent `window` frames (0 = all history)
+    void frameTimes(size_t window, std::vector<double>& cpu, std::vector<double>& gpu) const {
+        size_t begin = (window == 0 || history.size() <= window) ? 0 : history.size() - window;
+        for (size_t i = begin; i < history.size(); ++i) {
+            cpu.push_back(history[i].cpuMs);
+            if (history[i].gpuMs >= 0.0) gpu.push_back(history[i].gpuMs);
+        }
+    }
+
+    void inputLatencies(size_t window, std::vector<double>& latency) const {
+        size_t begin = (window == 0 || history.size() <= window) ? 0 : history.size() - window;
+        for (size_t i = begin; i < history.size(); ++i) {
+            if (history[i].latencyMs >= 0.0) latency.push_back(history[i].latencyMs);
+        }
+    }
+
+    std::string overlayText() const {
+        std::vector<double> cpu, gpu, latency;
+        frameTimes(overlayWindow, cpu, gpu);
+        inputLatencies(overlayWindow, latency);
+        Stats c = stats(cpu), g = stats(gpu), l = stats(latency);
+        char text[200];
+        int n = std::snprintf(text, sizeof(text), "CPU %.2f ms (p99 %.2f)  GPU %.2f ms (p99 %.2f)",
+                              c.average, c.p99, g.average, g.p99);
+        if (l.count > 0 && n > 0 && static_cast<size_t>(n) < sizeof(text)) {
+            std::snprintf(text + n, sizeof(text) - static_cast<size_t>(n), "  input %.1f ms (p99 %.1f)", l.average, l.p99);
+        }
+        return text;
+    }
+
+    void printSummary(std::ostream& out) const {
+        std::vector<double> cpu, gpu, latency;
+        frameTimes(0, cpu, gpu);
+        inputLatencies(0, latency);
+        Stats c = stats(cpu), g = stats(gpu), l = stats(latency);
+        char text[256];
+        std::snprintf(text, sizeof(text),
+                      "frames %zu | CPU avg %.3f p50 %.3f p99 %.3f max %.3f ms | GPU avg %.3f p50 %.3f p99 %.3f max %.3f ms",
+                      c.count, c.average, c.p50, c.p99, c.max, g.average, g.p50, g.p99, g.max);
+        out << text << std::endl;
+        if (l.count > 0) {
+            std::snprintf(text, sizeof(text), "input latency: %zu frames | avg %.3f p50 %.3f p99 %.3f max %.3f ms",
+                          l.count, l.average, l.p50, l.p99, l.max);
+            out << text << std::endl;
+        }
+        out << "dropped GPU results: " << droppedGpuFrames << " frames, " << droppedLatencySamples << " latency samples"
+            << std::endl;
+    }
+
+    // Long-format CSV: one row per frame total and per scope
+    bool writeCsv(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "frame,kind,name,start_ms,duration_ms\n";
+        for (const Frame& f : history) {
+            out << f.index << ",cpu,frame," << f.startMs << ',' << f.cpuMs << '\n';
+            if (f.gpuMs >= 0.0) out << f.index << ",gpu,frame," << f.startMs << ',' << f.gpuMs << '\n';
+            if (f.gpuMs < 0.0) out << f.index << ",gpu,dropped," << f.startMs << ",0\n";
+            if (f.latencyMs >= 0.0) out << f.index << ",input,latency," << f.inputMs << ',' << f.latencyMs << '\n';
+            if (f.inputMs >= 0.0 && f.latencyMs < 0.0) out << f.index << ",input,dropped," << f.inputMs << ",0\n";
+            for (const Sample& smp : f.cpu) out << f.index << ",cpu," << smp.name << ',' << smp.startMs << ',' << smp.durationMs << '\n';
+            for (const Sample& smp : f.gpu) out << f.index << ",gpu," << smp.name << ',' << smp.startMs << ',' << smp.durationMs << '\n';
+        }
+        return true;
+    }
+
+    // Chrome trace-event JSON (load in chrome://tracing or Perfetto); GPU passes on their own track
+    bool writeChromeTrace(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto event = [&](const char* name, double startMs, double durationMs, int tid) {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+                << ",\"ts\":" << startMs * 1000.0 << ",\"dur\":" << durationMs * 1000.0 << '}';
+            first = false;
+        };
+        for (const Frame& f : history) {
+            event("frame", f.startMs, f.cpuMs, 0);
+            if (f.latencyMs >= 0.0) event("input latency", f.inputMs, f.latencyMs, 2000);
+            for (const Sample& smp : f.cpu) event(smp.name, smp.startMs, smp.durationMs, smp.thread);
+            for (const Sample& smp : f.gpu) event(smp.name, smp.startMs, smp.durationMs, 1000);
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return true;
+    }
+};
+
+static Profiler profiler;
+
+// Times the enclosing block as a named CPU scope in the current profiler frame
+struct ProfileScope {
+    const char* name;
+    double startMs;
+    explicit ProfileScope(const char* scopeName) : name(scopeName), startMs(profiler.nowMs()) {}
+    ~ProfileScope() { profiler.recordCpu(name, startMs, profiler.nowMs() - startMs); }
+};
+
+// Brackets a render pass with a GPU timer query
+struct GpuScope {
+    explicit GpuScope(const char* name) { profiler.beginGpu(name); }
+    ~GpuScope() { profiler.endGpu(); }
+};
+
+// The frame as an explicit, ordered list of passes. Passes run in the order they were
+// added, each under a CPU profile scope of its name; disabled passes are skipped. Frame
+// state reaches the passes through whatever their closures capture.
+struct RenderGraph {
+    struct Pass {
+        const char* name;
+        std::function<void()> execute;
+        bool enabled = true;
+    };
+    std::vector<Pass> passes;
+
+    void add(const char* name, std::function<void()> execute) { passes.push_back({name, std::move(execute), true}); }
+
+    void setEnabled(const char* name, bool enabled) {
+        for (Pass& pass : passes) {
+            if (std::strcmp(pass.name, name) == 0) pass.enabled = enabled;
+        }
+    }
+
+    // For passes whose state depends on whether an earlier pass runs this frame
+    bool isEnabled(const char* name) const {
+        for (const Pass& pass : passes) {
+            if (std::strcmp(pass.name, name) == 0) return pass.enabled;
+        }
+        return false;
+    }
+
+    void execute() {
+        for (Pass& pass : passes) {
+            if (!pass.enabled) continue;
+            ProfileScope scope(pass.name);
+            pass.execute();
+        }
+    }
+};
+
+// Procedural heightfield. Heights are defined on an integer lattice (one world unit
+// apart) and the terrain mesh triangulates that lattice, so terrainHeight() below
+// returns exactly the surface that is drawn. The area around the origin stays flat at
+// groundLevel so the hand-placed level keeps its footing.
+static float latticeNoise(int x, int z) {
+    uint32_t h = static_cast<uint32_t>(x) * 0x8da6b343u ^ static_cast<uint32_t>(z) * 0xd8163841u;
+    h = (h ^ (h >> 13)) * 0x5bd1e995u;
+    h ^= h >> 15;
+    return static_cast<float>(h & 0xffffffu) / 16777215.0f;
+}
+
+static float valueNoise(float x, float z) {
+    int x0 = static_cast<int>(std::floor(x));
+    int z0 = static_cast<int>(std::floor(z));
+    float fx = x - static_cast<float>(x0);
+    float fz = z - static_cast<float>(z0);
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+    float a = latticeNoise(x0, z0), b = latticeNoise(x0 + 1, z0);
+    float c = latticeNoise(x0, z0 + 1), d = latticeNoise(x0 + 1, z0 + 1);
+    return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+static float latticeHeight(int x, int z) {
+    const float hillHeight = 9.0f;
+    float fx = static_cast<float>(x), fz = static_cast<float>(z);
+    float n = 0.0f, amplitude = 0.5f, frequency = 1.0f / 48.0f;
+    for (int octave = 0; octave < 4; ++octave) {
+        n += amplitude * valueNoise(fx * frequency, fz * frequency);
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    float blend = clamp((std::sqrt(fx * fx + fz * fz) - 16.0f) / 24.0f, 0.0f, 1.0f);
+    blend = blend * blend * (3.0f - 2.0f * blend);
+    return groundLevel + blend * hillHeight * n;
+}
+
+// Surface height at any XZ, matching the mesh's (00, 01, 10) / (10, 01, 11) triangle split
+static float terrainHeight(float x, float z) {
+    int x0 = static_cast<int>(std::floor(x));
+    int z0 = static_cast<int>(std::floor(z));
+    float fx = x - static_cast<float>(x0);
+    float fz = z - static_cast<float>(z0);
+    float h01 = latticeHeight(x0, z0 + 1), h10 = latticeHeight(x0 + 1, z0);
+    if (fx + fz <= 1.0f) {
+        float h00 = latticeHeight(x0, z0);
+        return h00 + (h10 - h00) * fx + (h01 - h00) * fz;
+    }
+    float h11 = latticeHeight(x0 + 1, z0 + 1);
+    return h11 + (h01 - h11) * (1.0f - fx) + (h10 - h11) * (1.0f - fz);
+}
+
+// Terrain LOD levels: level L draws every 2^L-th lattice vertex
+static const int terrainLodLevels = 3;
+
+// Distance thresholds for geometric LOD, derived from the projection (how large a
+// feature is on screen) and the fog density (how much of it survives the fog)
+struct LodRanges {
+    float terrain[terrainLodLevels];  // Terrain level L is used up to terrain[L]; the last is unbounded
+    float propDetail;                 // Full-detail prop meshes within this distance
+    float fogHidden;                  // Past this, fog leaves under 1% of a surface's colour
+};
+
+// Inverse of the fragment shader's fog: exp(-(d * density)^1.5) == 0.01
+static float fogHiddenDistance(float density) {
+    return std::pow(std::log(100.0f), 1.0f / 1.5f) / density;
+}
+
+static LodRanges computeLodRanges(float fovY, int viewportHeight, float fogDensity) {
+    const float terrainCellPixels = 24.0f;  // Switch a level down once its cells shrink below this
+    const float propPixels = 32.0f;         // Props drop to their far mesh below this size
+    const float minFinestRange = 18.0f;     // Keeps the finest terrain level around the viewer
+    float pixelsPerUnit = static_cast<float>(viewportHeight) / (2.0f * std::tan(0.5f * fovY));  // At distance 1
+
+    LodRanges lod{};
+    lod.fogHidden = fogHiddenDistance(fogDensity);
+    for (int level = 0; level < terrainLodLevels; ++level) {
+        float cell = static_cast<float>(1 << level);
+        float screen = cell * pixelsPerUnit / terrainCellPixels;
+        float fog = lod.fogHidden * cell / static_cast<float>(1 << (terrainLodLevels - 1));
+        float range = std::min(screen, fog);
+        // Each range must at least double the previous so neighbouring nodes differ by one level
+        lod.terrain[level] = level == 0 ? std::max(range, minFinestRange) : std::max(range, 2.0f * lod.terrain[level - 1]);
+    }
+    lod.terrain[terrainLodLevels - 1] = 1e30f;
+    lod.propDetail = std::min(pixelsPerUnit / propPixels, 0.5f * lod.fogHidden);
+    return lod;
+}
+
+// Streams square terrain tiles around the camera. Tiles are generated on job-system
+// workers straight into fixed-size slots of one vertex buffer (persistently mapped when
+// GL_ARB_buffer_storage is present, otherwise into the same slot of a staging copy
+// allocated once, then uploaded with glBufferSubData) and all tiles share one index
+// buffer, drawn with a per-slot base vertex. Tiles beyond the load radius (plus one ring
+// of hysteresis) are evicted; a slot is reused only after a fence shows the GPU has
+// finished the frames that drew its previous tile.
+//
+// Each tile is a CDLOD quadtree: a node at level L covers nodeCells * 2^L cells and is
+// drawn as the same nodeCells^2 grid at stride 2^L, so every node costs the same number
+// of triangles and only the nodes near the camera subdivide. Vertices that vanish at the
+// next coarser level carry that level's surface height and the vertex shader morphs them
+// onto it as the distance approaches the level's range, so there are no pops or cracks.
+struct Terrain {
+    static const int cellsPerChunk = 32;  // World units per tile side
+    static const int vertsPerSide = cellsPerChunk + 1;
+    static const int vertsPerChunk = vertsPerSide * vertsPerSide;
+    static const int floatsPerVertex = 10;  // Position, normal, texcoord (main shader layout) + morph target
+    static const int loadRadius = 4;        // Tiles kept in each direction around the camera tile
+    static const int maxRequestsPerFrame = 4;
+    static const int maxChunks = (2 * (loadRadius + 1) + 1) * (2 * (loadRadius + 1) + 1);  // One slot each
+    static const int nodeCells = cellsPerChunk >> (terrainLodLevels - 1);  // Grid cells per node side
+    static const int quadrantIndexCount = (nodeCells / 2) * (nodeCells / 2) * 6;
+
+    struct Chunk {
+        int cx = 0, cz = 0;
+        int slot = -1;
+        Aabb bounds{};
+        JobCounter generated;
+        bool uploaded = false;
+    };
+
+    struct Slot {
+        GLsync fence = nullptr;  // Set when the slot's previous tile was evicted
+        bool used = false;
+    };
+
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    float* mapped = nullptr;  // Persistent mapping of the whole vertex buffer, if available
+    std::vector<float> staging;  // Otherwise a client copy laid out by slot, allocated once
+    std::vector<Slot> slots;
+    Pool<Chunk> chunkPool;
+    std::vector<Chunk*> chunks;  // Resident and pending tiles; never more than there are slots
+    std::vector<Aabb> changedBounds;  // Tiles that appeared or disappeared in the last update()
+
+    bool resident(int cx, int cz) const {
+        for (const Chunk* chunk : chunks) {
+            if (chunk->cx == cx && chunk->cz == cz) return true;
+        }
+        return false;
+    }
+
+    static int chunkCoord(float world) {
+        return static_cast<int>(std::floor(world / static_cast<float>(cellsPerChunk)));
+    }
+
+    void init() {
+        slots.resize(static_cast<size_t>(maxChunks));
+        chunks.reserve(slots.size());
+        changedBounds.reserve(slots.size());
+        GLsizeiptr bytes = static_cast<GLsizeiptr>(slots.size() * vertsPerChunk * floatsPerVertex * sizeof(float));
+
+        // One node grid per level, relative to the node's corner vertex and split into four
+        // contiguous quadrants so a node can be drawn partially when its children refine
+        std::vector<GLushort> indices;
+        const int half = nodeCells / 2;
+        for (int level = 0; level < terrainLodLevels; ++level) {
+            int stride = 1 << level;
+            for (int quadrant = 0; quadrant < 4; ++quadrant) {
+                int qx = (quadrant & 1) * half, qz = (quadrant >> 1) * half;
+                for (int z = qz; z < qz + half; ++z) {
+                    for (int x = qx; x < qx + half; ++x) {
+                        GLushort v00 = static_cast<GLushort>(z * stride * vertsPerSide + x * stride);
+                        GLushort v10 = static_cast<GLushort>(v00 + stride);
+                        GLushort v01 = static_cast<GLushort>(v00 + stride * vertsPerSide);
+                        GLushort v11 = static_cast<GLushort>(v01 + stride);
+                        indices.insert(indices.end(), {v00, v01, v10, v10, v01, v11});
+                    }
+                }
+            }
+        }
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+            mapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+        }
+        if (!mapped) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+            staging.resize(static_cast<size_t>(bytes) / sizeof(float));
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLushort)),
+                     indices.data(), GL_STATIC_DRAW);
+
+        GLsizei stride = floatsPerVertex * sizeof(float);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+        glEnableVertexAttribArray(8);
+        glBindVertexArray(0);
+    }
+
+    // Level at which a tile-local lattice coordinate first disappears (it is kept by
+    // every level below it); corners of the tile survive all levels
+    static int vertexLevel(int local) {
+        if (local == 0) return terrainLodLevels;
+        int level = 0;
+        while (((local >> level) & 1) == 0) ++level;
+        return level;
+    }
+
+    // Height of the next coarser level's surface under a vertex that level drops. Edge
+    // midpoints take the mean of the edge; cell centres sit on the (01, 10) diagonal.
+    static float coarserHeight(int wx, int wz, int localX, int localZ, int level) {
+        int s = 1 << level;
+        bool oddX = ((localX >> level) & 1) != 0;
+        bool oddZ = ((localZ >> level) & 1) != 0;
+        if (oddX && oddZ) return 0.5f * (latticeHeight(wx - s, wz + s) + latticeHeight(wx + s, wz - s));
+        if (oddX) return 0.5f * (latticeHeight(wx - s, wz) + latticeHeight(wx + s, wz));
+        return 0.5f * (latticeHeight(wx, wz - s) + latticeHeight(wx, wz + s));
+    }
+
+    // Fill one tile's vertices (runs on a worker); returns its bounds
+    static Aabb generate(int cx, int cz, float* out) {
+        const float texScale = 0.1f;  // One checker tile per 10 world units
+        int baseX = cx * cellsPerChunk, baseZ = cz * cellsPerChunk;
+        Aabb bounds{{static_cast<float>(baseX), 1e30f, static_cast<float>(baseZ)},
+                    {static_cast<float>(baseX + cellsPerChunk), -1e30f, static_cast<float>(baseZ + cellsPerChunk)}};
+        for (int z = 0; z < vertsPerSide; ++z) {
+            for (int x = 0; x < vertsPerSide; ++x) {
+                int wx = baseX + x, wz = baseZ + z;
+                float h = latticeHeight(wx, wz);
+                Vec3 normal = normalize({latticeHeight(wx - 1, wz) - latticeHeight(wx + 1, wz), 2.0f,
+                                         latticeHeight(wx, wz - 1) - latticeHeight(wx, wz + 1)});
+                float* v = out + (z * vertsPerSide + x) * floatsPerVertex;
+                v[0] = static_cast<float>(wx); v[1] = h; v[2] = static_cast<float>(wz);
+                v[3] = normal.x; v[4] = normal.y; v[5] = normal.z;
+                v[6] = static_cast<float>(wx) * texScale; v[7] = static_cast<float>(wz) * texScale;
+                int level = std::min(vertexLevel(x), vertexLevel(z));
+                v[8] = level < terrainLodLevels - 1 ? coarserHeight(wx, wz, x, z, level) : h;
+                v[9] = static_cast<float>(level);
+                bounds.min.y = std::min(bounds.min.y, h);
+                bounds.max.y = std::max(bounds.max.y, h);
+            }
+        }
+        return bounds;
+    }
+
+    int acquireSlot() {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            Slot& slot = slots[i];
+            if (slot.used) continue;
+            if (slot.fence) {
+                if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) continue;
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+            }
+            slot.used = true;
+            return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Where a worker writes a slot's vertices: the mapping itself, or the slot's staging slab
+    float* slotPointer(int slot) {
+        float* base = mapped ? mapped : staging.data();
+        return base + static_cast<size_t>(slot) * vertsPerChunk * floatsPerVertex;
+    }
+
+    // Evict far tiles, upload finished ones and request missing ones, nearest first
+    void update(const Vec3& cameraPos, JobSystem& jobs, int requestBudget = maxRequestsPerFrame) {
+        int ccx = chunkCoord(cameraPos.x), ccz = chunkCoord(cameraPos.z);
+        changedBounds.clear();
+
+        for (size_t i = 0; i < chunks.size();) {
+            Chunk& chunk = *chunks[i];
+            bool far = std::abs(chunk.cx - ccx) > loadRadius + 1 || std::abs(chunk.cz - ccz) > loadRadius + 1;
+            if (far && chunk.generated.done()) {
+                // Draws from earlier frames may still be reading the slot
+                Slot& slot = slots[static_cast<size_t>(chunk.slot)];
+                slot.used = false;
+                if (chunk.uploaded) {
+                    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    changedBounds.push_back(chunk.bounds);
+                }
+                chunkPool.destroy(&chunk);
+                chunks[i] = chunks.back();
+                chunks.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        for (Chunk* entry : chunks) {
+            Chunk& chunk = *entry;
+            if (chunk.uploaded || !chunk.generated.done()) continue;
+            if (!mapped) {
+                GLintptr offset = static_cast<GLintptr>(chunk.slot) * vertsPerChunk * floatsPerVertex * sizeof(float);
+                glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                glBufferSubData(GL_ARRAY_BUFFER, offset, vertsPerChunk * floatsPerVertex * sizeof(float),
+                                slotPointer(chunk.slot));
+            }
+            chunk.uploaded = true;
+            changedBounds.push_back(chunk.bounds);
+        }
+
+        // Rings of increasing distance so the tiles under and near the camera arrive first
+        for (int ring = 0; ring <= loadRadius && requestBudget > 0; ++ring) {
+            for (int dz = -ring; dz <= ring && requestBudget > 0; ++dz) {
+                for (int dx = -ring; dx <= ring && requestBudget > 0; ++dx) {
+                    if (std::max(std::abs(dx), std::abs(dz)) != ring) continue;
+                    int cx = ccx + dx, cz = ccz + dz;
+                    if (resident(cx, cz)) continue;
+                    int slot = acquireSlot();
+                    if (slot < 0) return;
+                    Chunk* chunk = chunkPool.create();
+                    chunk->cx = cx;
+                    chunk->cz = cz;
+                    chunk->slot = slot;
+                    float* out = slotPointer(slot);
+                    Chunk* target = chunk;
+                    chunks.push_back(chunk);
+                    jobs.submit([target, out]() { target->bounds = generate(target->cx, target->cz, out); },
+                                &target->generated);
+                    --requestBudget;
+                }
+            }
+        }
+    }
+
+    // Block until every requested tile is generated (startup and shutdown)
+    void finishPending(JobSystem& jobs) {
+        for (Chunk* chunk : chunks) jobs.wait(chunk->generated);
+    }
+
+    struct DrawContext {
+        const Frustum& frustum;
+        Vec3 camera;
+        const LodRanges& lod;
+        GLint lodLoc;
+        int boundLevel;
+        int fixedLevel;  // >= 0: every node at this level, unmorphed (independent of the camera)
+    };
+
+    static bool withinRange(const Vec3& p, const Aabb& box, float range) {
+        float dx = std::max({box.min.x - p.x, 0.0f, p.x - box.max.x});
+        float dy = std::max({box.min.y - p.y, 0.0f, p.y - box.max.y});
+        float dz = std::max({box.min.z - p.z, 0.0f, p.z - box.max.z});
+        return dx * dx + dy * dy + dz * dz <= range * range;
+    }
+
+    Aabb nodeBounds(const Chunk& chunk, int x0, int z0, int cells) const {
+        float bx = static_cast<float>(chunk.cx * cellsPerChunk + x0);
+        float bz = static_cast<float>(chunk.cz * cellsPerChunk + z0);
+        return {{bx, chunk.bounds.min.y, bz}, {bx + cells, chunk.bounds.max.y, bz + cells}};
+    }
+
+    void drawQuadrant(DrawContext& ctx, const Chunk& chunk, int level, int x0, int z0, int quadrant) const {
+        if (ctx.boundLevel != level) {
+            // Morph over the last quarter of the level's range; the coarsest level never morphs
+            bool morphs = ctx.fixedLevel < 0 && level < terrainLodLevels - 1;
+            float end = ctx.lod.terrain[level];
+            glUniform3f(ctx.lodLoc, morphs ? static_cast<float>(level) : -1.0f, 0.75f * end, end);
+            ctx.boundLevel = level;
+        }
+        GLint base = chunk.slot * vertsPerChunk + z0 * vertsPerSide + x0;
+        const void* offset = (void*)(static_cast<size_t>(level * 4 + quadrant) * quadrantIndexCount * sizeof(GLushort));
+        glDrawElementsBaseVertex(GL_TRIANGLES, quadrantIndexCount, GL_UNSIGNED_SHORT, offset, base);
+    }
+
+    // CDLOD selection: refine a node only where its children fall inside the finer range
+    int drawNode(DrawContext& ctx, const Chunk& chunk, int level, int x0, int z0) const {
+        int cells = nodeCells << level;
+        if (cullAabb(ctx.frustum, nodeBounds(chunk, x0, z0, cells)) == CullResult::Outside) return 0;
+        int half = cells / 2;
+        int drawn = 0;
+        for (int quadrant = 0; quadrant < 4; ++quadrant) {
+            int qx = x0 + (quadrant & 1) * half, qz = z0 + (quadrant >> 1) * half;
+            Aabb child = nodeBounds(chunk, qx, qz, half);
+            bool refine = ctx.fixedLevel >= 0 ? level > ctx.fixedLevel
+                                              : level > 0 && withinRange(ctx.camera, child, ctx.lod.terrain[level - 1]);
+            if (refine) {
+                drawn += drawNode(ctx, chunk, level - 1, qx, qz);
+            } else if (cullAabb(ctx.frustum, child) != CullResult::Outside) {
+                drawQuadrant(ctx, chunk, level, x0, z0, quadrant);
+                ++drawn;
+            }
+        }
+        return drawn;
+    }
+
+    // Draws every resident tile, nearest first so early depth rejects hidden fragments;
+    // returns the number of quadrant draws issued. fixedLevel >= 0 ignores the camera's LOD
+    // cut, for views that outlive the camera position (cached shadow cascades).
+    int draw(const Frustum& frustum, const Vec3& cameraPos, const LodRanges& lod, GLint lodLoc,
+             int fixedLevel = -1) const {
+        std::pair<float, const Chunk*> order[maxChunks];
+        size_t count = 0;
+        for (const Chunk* chunk : chunks) {
+            if (!chunk->uploaded) continue;
+            float dx = (static_cast<float>(chunk->cx) + 0.5f) * cellsPerChunk - cameraPos.x;
+            float dz = (static_cast<float>(chunk->cz) + 0.5f) * cellsPerChunk - cameraPos.z;
+            order[count++] = {dx * dx + dz * dz, chunk};
+        }
+        std::sort(order, order + count, [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        DrawContext ctx{frustum, cameraPos, lod, lodLoc, -2, fixedLevel};
+        int drawn = 0;
+        glBindVertexArray(vao);
+        for (size_t i = 0; i < count; ++i) drawn += drawNode(ctx, *order[i].second, terrainLodLevels - 1, 0, 0);
+        glUniform3f(lodLoc, -1.0f, 0.0f, 1.0f);  // Other geometry never morphs
+        return drawn;
+    }
+
+    void destroy(JobSystem& jobs) {
+        finishPending(jobs);
+        for (Chunk* chunk : chunks) chunkPool.destroy(chunk);
+        chunks.clear();
+        for (Slot& slot : slots) {
+            if (slot.fence) glDeleteSync(slot.fence);
+        }
+        slots.clear();
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mapped = nullptr;
+        }
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+    }
+};
+
+// Cascaded sun shadow maps, one depth layer per cascade. Cascade i shades everything within
+// split distance i of the camera. Its square light-space region is centred on the camera
+// (not the view direction, so turning never invalidates it) and padded by a margin, so the
+// cached depth stays valid until the camera walks out of the margin, the sun moves or a
+// caster inside the region changes. Only those cascades are re-fitted and re-rendered.
+struct ShadowCascades {
+    static const int count = 3;
+    static const int size = 1024;
+    static constexpr float shadowDistance = 80.0f;  // Past this the fog hides most of the ground
+    static constexpr float casterReach = 40.0f;     // How far sunwards of a region casters can still shadow it
+
+    struct Cascade {
+        float split = 0.0f;   // Camera distance shaded by this cascade
+        float margin = 0.0f;  // Camera movement the cached region tolerates
+        float radius = 0.0f;  // Half-extent of the light-space region: split + margin
+        Vec3 center{};
+        Mat4 view{};
+        Mat4 projection{};
+        Frustum frustum{};  // Light frustum, for culling casters
+        Aabb bounds{};      // World box around the whole light volume, for invalidation
+        int terrainLevel = -1;  // Fixed terrain LOD its casters are drawn at (see casterLevel)
+        bool fitted = false;
+        bool dirty = true;  // Depth must be re-rendered before it is sampled
+    };
+
+    // std140 mirror of the shaders' ShadowData block
+    struct Uniforms {
+        Mat4 shadowMatrix[count];  // World -> cascade texture space
+        float splits[4];
+        float texelSize[4];        // World size of one texel per cascade (normal offset)
+    };
+
+    Cascade cascades[count];
+    Vec3 lightDir{0.0f, -1.0f, 0.0f};
+    GLuint texture = 0, fbo = 0;
+    uint64_t renders = 0;  // Cascade renders since startup
+
+    void init() {
+        // Practical split scheme: blend of logarithmic and uniform splits (lambda 0.75)
+        const float nearSplit = 1.0f, lambda = 0.75f;
+        for (int i = 0; i < count; ++i) {
+            float t = static_cast<float>(i + 1) / count;
+            float logSplit = nearSplit * std::pow(shadowDistance / nearSplit, t);
+            float uniformSplit = nearSplit + (shadowDistance - nearSplit) * t;
+            cascades[i].split = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+            cascades[i].margin = 0.25f * cascades[i].split;
+            cascades[i].radius = cascades[i].split + cascades[i].margin;
+        }
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, count, 0, GL_DEPTH_COMPONENT,
+                     GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        const float border[4] = {1.0f, 1.0f, 1.0f, 1.0f};  // Outside a cascade counts as lit
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Shadow map framebuffer incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Coarsest terrain level the camera's CDLOD cut shades within `distance`, counting the
+    // level that vertices past a range's morph start blend towards. Terrain casters drawn at
+    // this level are never finer than what the cascade shades, so a finer caster surface
+    // can't poke out over a coarse, distant receiver and shadow it.
+    static int casterLevel(const LodRanges& lod, float distance) {
+        int level = 0;
+        while (level < terrainLodLevels - 1 && 0.75f * lod.terrain[level] < distance) ++level;
+        return level;
+    }
+
+    // Re-fit cascades the camera has walked out of (all of them if the sun moved), and
+    // re-render those whose caster level changed with the LOD ranges
+    void update(const Vec3& cameraPos, const Vec3& sunDirection, const LodRanges& lod) {
+        Vec3 dir = normalize(sunDirection);
+        bool lightMoved = dir.x != lightDir.x || dir.y != lightDir.y || dir.z != lightDir.z;
+        lightDir = dir;
+        for (Cascade& cascade : cascades) {
+            Vec3 d = sub(cameraPos, cascade.center);
+            if (lightMoved || !cascade.fitted || dot(d, d) > cascade.margin * cascade.margin) fit(cascade, cameraPos);
+            int level = casterLevel(lod, cascade.split);
+            if (level != cascade.terrainLevel) {
+                cascade.terrainLevel = level;
+                cascade.dirty = true;
+            }
+        }
+    }
+
+    // Casters inside `box` changed: re-render every cascade whose light volume touches it
+    void invalidate(const Aabb& box) {
+        for (Cascade& cascade : cascades) {
+            const Aabb& b = cascade.bounds;
+            if (box.min.x <= b.max.x && box.max.x >= b.min.x && box.min.y <= b.max.y && box.max.y >= b.min.y &&
+                box.min.z <= b.max.z && box.max.z >= b.min.z) {
+                cascade.dirty = true;
+            }
+        }
+    }
+
+    void invalidateAll() {
+        for (Cascade& cascade : cascades) cascade.dirty = true;
+    }
+
+    bool anyDirty() const {
+        for (const Cascade& cascade : cascades) {
+            if (cascade.dirty) return true;
+        }
+        return false;
+    }
+
+    Uniforms uniforms() const {
+        Uniforms u{};
+        Mat4 bias = identity();  // Clip space [-1, 1] -> texture space [0, 1]
+        bias.m[0] = bias.m[5] = bias.m[10] = 0.5f;
+        bias.m[12] = bias.m[13] = bias.m[14] = 0.5f;
+        for (int i = 0; i < count; ++i) {
+            u.shadowMatrix[i] = multiply(multiply(cascades[i].view, cascades[i].projection), bias);
+            u.splits[i] = cascades[i].split;
+            u.texelSize[i] = 2.0f * cascades[i].radius / size;
+        }
+        return u;
+    }
+
+    // Bind cascade i's layer as the depth target and clear it
+    void beginRender(int i) const {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+        glViewport(0, 0, size, size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &texture);
+    }
+
+private:
+    void fit(Cascade& cascade, const Vec3& cameraPos) const {
+        Vec3 up = std::fabs(lightDir.y) > 0.99f ? Vec3{0.0f, 0.0f, 1.0f} : Vec3{0.0f, 1.0f, 0.0f};
+        Vec3 right = normalize(cross(lightDir, up));
+        Vec3 lightUp = cross(right, lightDir);
+
+        // Snap the centre to whole texels in light space so a re-fit keeps the same sampling grid
+        float texel = 2.0f * cascade.radius / size;
+        float x = dot(cameraPos, right), y = dot(cameraPos, lightUp);
+        cascade.center = add(cameraPos, add(mul(right, std::floor(x / texel) * texel - x),
+                                            mul(lightUp, std::floor(y / texel) * texel - y)));
+
+        float back = cascade.radius + casterReach;
+        cascade.view = lookAt(sub(cascade.center, mul(lightDir, back)), cascade.center, up);
+        cascade.projection = orthographic(-cascade.radius, cascade.radius, -cascade.radius, cascade.radius, 0.0f,
+                                          back + cascade.radius);
+        cascade.frustum = extractFrustum(multiply(cascade.view, cascade.projection));
+
+        Aabb bounds{cascade.center, cascade.center};
+        for (int corner = 0; corner < 8; ++corner) {
+            float a = (corner & 1) ? cascade.radius : -cascade.radius;
+            float b = (corner & 2) ? cascade.radius : -cascade.radius;
+            float t = (corner & 4) ? cascade.radius : -back;
+            Vec3 p = add(cascade.center, add(add(mul(right, a), mul(lightUp, b)), mul(lightDir, t)));
+            bounds = mergeAabb(bounds, {p, p});
+        }
+        cascade.bounds = bounds;
+        cascade.fitted = true;
+        cascade.dirty = true;
+    }
+};
+
+// Point light: a sphere of influence in world space; intensity scales the color
+struct PointLight {
+    Vec3 position;
+    float radius;
+    Vec3 color;
+    float intensity;
+};
+
+// Clustered forward shading. The view frustum is cut into tilesX x tilesY screen tiles by
+// depthSlices exponential depth slices, and each frame every light is binned into the clusters
+// its sphere overlaps, so a fragment only loops over its own cluster's list. The grid, index
+// list and light data reach the shader through texture buffers (GL 3.3 has no storage buffers).
+struct ClusteredLights {
+    static const int tilesX = 16, tilesY = 9, depthSlices = 24;
+    static const int clusterCount = tilesX * tilesY * depthSlices;
+    static const int clustersPerSlice = tilesX * tilesY;
+    static const int maxLights = 4096;
+    static const int maxLightsPerCluster = 96;  // Further lights in a crowded cluster are dropped
+
+    // std140 mirror of the shaders' LightGrid block
+    struct Uniforms {
+        float scale[4];  // xy = pixels per tile, z/w: slice = log(view depth) * z + w
+        int dims[4];     // tilesX, tilesY, depthSlices, light count
+    };
+
+    std::vector<Aabb> clusterBounds;   // View space, rebuilt when the projection changes
+    std::vector<uint32_t> grid;        // Per cluster: first index, count
+    std::vector<GLushort> indices;     // Packed light lists, slice by slice
+    std::vector<GLushort> sliceScratch;  // maxLightsPerCluster entries per cluster before packing
+    std::vector<uint32_t> sliceUsed;
+    std::vector<float> lightData;      // Two RGBA32F texels per light: position, radius; color * intensity, 0
+    std::vector<int> lightRange;       // Per light: x0, x1, y0, y1, z0, z1 cluster range (z0 > z1 = culled)
+    std::vector<float> lightView;      // Per light: view-space centre and radius
+    GLuint gridBuffer = 0, indexBuffer = 0, lightBuffer = 0;
+    GLuint gridTexture = 0, indexTexture = 0, lightTexture = 0;
+    Uniforms uniforms{};
+    size_t lightCount = 0;
+    uint32_t maxClusterLights = 0;  // Longest list in the last build
+    // The packed index list must fit GL_MAX_TEXTURE_BUFFER_SIZE, which GL 3.3 only guarantees
+    // to be 65536 texels. Entries past it are dropped from the farthest slices, which pack last.
+    size_t indexBudget = 65536;
+    size_t droppedIndices = 0;  // Cluster entries cut by the budget in the last build
+    bool reportedBudget = false;
+
+    void init() {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        indexBudget = static_cast<size_t>(std::max(maxTexels, 65536));
+
+        clusterBounds.resize(clusterCount);
+        grid.resize(static_cast<size_t>(clusterCount) * 2);
+        sliceScratch.resize(static_cast<size_t>(clusterCount) * maxLightsPerCluster);
+        sliceUsed.resize(depthSlices);
+        indices.reserve(sliceScratch.size());
+        lightData.reserve(static_cast<size_t>(maxLights) * 8);
+        lightRange.reserve(static_cast<size_t>(maxLights) * 6);
+        lightView.reserve(static_cast<size_t>(maxLights) * 4);
+
+        GLuint buffers[3];
+        GLuint textures[3];
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        gridBuffer = buffers[0], indexBuffer = buffers[1], lightBuffer = buffers[2];
+        gridTexture = textures[0], indexTexture = textures[1], lightTexture = textures[2];
+        const GLenum formats[3] = {GL_RG32UI, GL_R16UI, GL_RGBA32F};
+        for (int i = 0; i < 3; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Cluster boxes for a projection; cheap enough to call each frame, skipped when unchanged
+    void setProjection(float fovY, float aspectRatio, float zNear, float zFar, int viewWidth, int viewHeight) {
+        float tanHalf = std::tan(0.5f * fovY);
+        if (tanHalf == tanHalfY && aspectRatio == aspect && zNear == nearZ && zFar == farZ && viewWidth == width &&
+            viewHeight == height) {
+            return;
+        }
+        tanHalfY = tanHalf;
+        aspect = aspectRatio;
+        nearZ = zNear;
+        farZ = zFar;
+        width = viewWidth;
+        height = viewHeight;
+        float tile[2] = {std::ceil(static_cast<float>(width) / tilesX), std::ceil(static_cast<float>(height) / tilesY)};
+        float logRatio = std::log(farZ / nearZ);
+        uniforms.scale[0] = tile[0];
+        uniforms.scale[1] = tile[1];
+        uniforms.scale[2] = depthSlices / logRatio;
+        uniforms.scale[3] = -depthSlices * std::log(nearZ) / logRatio;
+        uniforms.dims[0] = tilesX;
+        uniforms.dims[1] = tilesY;
+        uniforms.dims[2] = depthSlices;
+
+        for (int k = 0; k < depthSlices; ++k) {
+            float z0 = nearZ * std::pow(farZ / nearZ, static_cast<float>(k) / depthSlices);
+            float z1 = nearZ * std::pow(farZ / nearZ, static_cast<float>(k + 1) / depthSlices);
+            for (int y = 0; y < tilesY; ++y) {
+                for (int x = 0; x < tilesX; ++x) {
+                    float nx[2] = {tileNdc(x, tile[0], width), tileNdc(x + 1, tile[0], width)};
+                    float ny[2] = {tileNdc(y, tile[1], height), tileNdc(y + 1, tile[1], height)};
+                    Aabb box{{1e30f, 1e30f, 1e30f}, {-1e30f, -1e30f, -1e30f}};
+                    for (int corner = 0; corner < 8; ++corner) {
+                        float z = (corner & 4) ? z1 : z0;
+                        Vec3 p{nx[corner & 1] * z * tanHalfY * aspect, ny[(corner >> 1) & 1] * z * tanHalfY, -z};
+                        box = mergeAabb(box, {p, p});
+                    }
+                    clusterBounds[static_cast<size_t>((k * tilesY + y) * tilesX + x)] = box;
+                }
+            }
+        }
+    }
+
+    // Bin `count` lights against the camera `view` and upload grid, lists and lights
+    void build(const PointLight* lights, size_t count, const Mat4& view, JobSystem& jobs) {
+        lightCount = std::min(count, static_cast<size_t>(maxLights));
+        uniforms.dims[3] = static_cast<int>(lightCount);
+        lightData.resize(lightCount * 8);
+        lightRange.resize(lightCount * 6);
+        lightView.resize(lightCount * 4);
+        const float* m = view.m;
+        jobs.parallelFor(lightCount, 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const PointLight& light = lights[i];
+                const Vec3& p = light.position;
+                Vec3 c{m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12], m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+                       m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]};
+                float* data = &lightData[i * 8];
+                data[0] = p.x, data[1] = p.y, data[2] = p.z, data[3] = light.radius;
+                data[4] = light.color.x * light.intensity, data[5] = light.color.y * light.intensity;
+                data[6] = light.color.z * light.intensity, data[7] = 0.0f;
+                float* v = &lightView[i * 4];
+                v[0] = c.x, v[1] = c.y, v[2] = c.z, v[3] = light.radius;
+                binRange(c, light.radius, &lightRange[i * 6]);
+            }
+        });
+
+        // One job per depth slice fills that slice's part of the scratch lists
+        jobs.parallelFor(depthSlices, 1, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) binSlice(static_cast<int>(k));
+        });
+
+        // Pack the slices' lists back to back, clipping whatever overflows indexBudget
+        indices.clear();
+        maxClusterLights = 0;
+        droppedIndices = 0;
+        for (int k = 0; k < depthSlices; ++k) {
+            size_t sliceBase = static_cast<size_t>(k) * clustersPerSlice * maxLightsPerCluster;
+            uint32_t shift = static_cast<uint32_t>(indices.size());
+            uint32_t kept = static_cast<uint32_t>(std::min<size_t>(sliceUsed[k], indexBudget - indices.size()));
+            droppedIndices += sliceUsed[k] - kept;
+            indices.insert(indices.end(), sliceScratch.begin() + sliceBase, sliceScratch.begin() + sliceBase + kept);
+            for (int c = k * clustersPerSlice; c < (k + 1) * clustersPerSlice; ++c) {
+                uint32_t& first = grid[static_cast<size_t>(c) * 2];
+                uint32_t& count = grid[static_cast<size_t>(c) * 2 + 1];
+                count = first >= kept ? 0 : std::min(count, kept - first);
+                first += shift;
+                maxClusterLights = std::max(maxClusterLights, count);
+            }
+        }
+        if (droppedIndices > 0 && !reportedBudget) {
+            std::cout << "point lights: cluster lists exceed the " << indexBudget
+                      << "-texel texture buffer limit, dropping lights in the farthest clusters" << std::endl;
+            reportedBudget = true;
+        }
+
+        upload(gridBuffer, grid.data(), grid.size() * sizeof(uint32_t));
+        upload(indexBuffer, indices.data(), indices.size() * sizeof(GLushort));
+        upload(lightBuffer, lightData.data(), lightData.size() * sizeof(float));
+    }
+
+    // Grid on texture unit `unit`, lists on unit + 1, lights on unit + 2
+    void bind(GLenum unit) const {
+        const GLuint textures[3] = {gridTexture, indexTexture, lightTexture};
+        for (GLenum i = 0; i < 3; ++i) {
+            glActiveTexture(unit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+    }
+
+    void destroy() {
+        GLuint buffers[3] = {gridBuffer, indexBuffer, lightBuffer};
+        GLuint textures[3] = {gridTexture, indexTexture, lightTexture};
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+private:
+    float tanHalfY = 0.0f, aspect = 0.0f, nearZ = 0.1f, farZ = 1.0f;
+    int width = 1, height = 1;
+
+    static float tileNdc(int tile, float tileSize, int pixels) {
+        return std::min(1.0f, -1.0f + 2.0f * tile * tileSize / static_cast<float>(pixels));
+    }
+
+    int sliceOf(float depth) const {
+        int k = static_cast<int>(std::floor(std::log(depth) * uniforms.scale[2] + uniforms.scale[3]));
+        return std::max(0, std::min(depthSlices - 1, k));
+    }
+
+    int tileOf(float ndc, float tileSize, int pixels, int tiles) const {
+        int t = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(pixels) / tileSize));
+        return std::max(0, std::min(tiles - 1, t));
+    }
+
+    // Conservative cluster range of a view-space sphere: its view-space box projected at the
+    // depth that widens each edge most
+    void binRange(const Vec3& c, float r, int* range) const {
+        float zNear = -c.z - r, zFar = -c.z + r;
+        if (zFar < nearZ || zNear > farZ) {
+            range[4] = 1, range[5] = 0;
+            return;
+        }
+        zNear = std::max(zNear, nearZ);
+        zFar = std::min(zFar, farZ);
+        float sx = 1.0f / (tanHalfY * aspect), sy = 1.0f / tanHalfY;
+        float x0 = c.x - r, x1 = c.x + r, y0 = c.y - r, y1 = c.y + r;
+        float nx0 = sx * x0 / (x0 < 0.0f ? zNear : zFar), nx1 = sx * x1 / (x1 > 0.0f ? zNear : zFar);
+        float ny0 = sy * y0 / (y0 < 0.0f ? zNear : zFar), ny1 = sy * y1 / (y1 > 0.0f ? zNear : zFar);
+        if (nx0 > 1.0f || nx1 < -1.0f || ny0 > 1.0f || ny1 < -1.0f) {
+            range[4] = 1, range[5] = 0;
+            return;
+        }
+        range[0] = tileOf(nx0, uniforms.scale[0], width, tilesX);
+        range[1] = tileOf(nx1, uniforms.scale[0], width, tilesX);
+        range[2] = tileOf(ny0, uniforms.scale[1], height, tilesY);
+        range[3] = tileOf(ny1, uniforms.scale[1], height, tilesY);
+        range[4] = sliceOf(zNear);
+        range[5] = sliceOf(zFar);
+    }
+
+    // Lights are visited in index order and write into per-cluster runs of the scratch
+    // space, which are then packed to the front of the slice's range
+    void binSlice(int k) {
+        size_t sliceBase = static_cast<size_t>(k) * clustersPerSlice * maxLightsPerCluster;
+        int firstCluster = k * clustersPerSlice;
+        for (int c = firstCluster; c < firstCluster + clustersPerSlice; ++c) grid[static_cast<size_t>(c) * 2 + 1] = 0;
+        for (size_t i = 0; i < lightCount; ++i) {
+            const int* range = &lightRange[i * 6];
+            if (k < range[4] || k > range[5]) continue;
+            const float* v = &lightView[i * 4];
+            for (int y = range[2]; y <= range[3]; ++y) {
+                for (int x = range[0]; x <= range[1]; ++x) {
+                    int cluster = firstCluster + y * tilesX + x;
+                    uint32_t& count = grid[static_cast<size_t>(cluster) * 2 + 1];
+                    if (count == maxLightsPerCluster) continue;
+                    // Sphere against the cluster box
+                    const Aabb& box = clusterBounds[static_cast<size_t>(cluster)];
+                    float dx = std::max(std::max(box.min.x - v[0], 0.0f), v[0] - box.max.x);
+                    float dy = std::max(std::max(box.min.y - v[1], 0.0f), v[1] - box.max.y);
+                    float dz = std::max(std::max(box.min.z - v[2], 0.0f), v[2] - box.max.z);
+                    if (dx * dx + dy * dy + dz * dz > v[3] * v[3]) continue;
+                    sliceScratch[static_cast<size_t>(cluster) * maxLightsPerCluster + count++] = static_cast<GLushort>(i);
+                }
+            }
+        }
+        uint32_t used = 0;
+        for (int c = firstCluster; c < firstCluster + clustersPerSlice; ++c) {
+            uint32_t count = grid[static_cast<size_t>(c) * 2 + 1];
+            if (count) {
+                std::memmove(&sliceScratch[sliceBase + used], &sliceScratch[static_cast<size_t>(c) * maxLightsPerCluster],
+                             count * sizeof(GLushort));
+            }
+            grid[static_cast<size_t>(c) * 2] = used;
+            used += count;
+        }
+        sliceUsed[static_cast<size_t>(k)] = used;
+    }
+
+    static void upload(GLuint buffer, const void* data, size_t bytes) {
+        // Orphan last frame's storage; never zero-sized so the texture buffer stays valid
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+        if (bytes) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+};
+
+// GPU-driven prop culling (GL 4.3 compute). The Scene columns are mirrored in storage buffers
+// and one invocation per prop tests it against the frustum and against a hierarchical-Z
+// pyramid built from the previous frame's depth texture (seen through that frame's view-projection),
+// picks its LOD and appends its model matrix and tint to the instance buffers, counting it
+// into the indirect command of its (mesh, LOD). The CPU work per frame is a few uniforms and
+// dispatches, however many props there are.
+struct GpuCulling {
+    static const GLuint groupSize = 64;        // Cull shader invocations per workgroup
+    static const GLuint tileSize = 8;          // Hi-Z shaders work on 8x8 texel tiles
+    static const GLuint hizTextureUnit = 6;    // Units 0-5 belong to the shading passes
+    enum Column { Positions, Rotations, Scales, Tints, Bounds, MeshIds, ColumnCount };
+
+    bool supported = false;
+    GLuint cullProgram = 0, copyProgram = 0, reduceProgram = 0;
+    GLuint columns[ColumnCount] = {};
+    GLuint commandBuffer = 0;                // DrawCommands, one per (mesh, LOD); counted into by the shader
+    GLuint matrixBuffer = 0, tintBuffer = 0;  // Surviving instances, read back as vertex attributes 3-7
+    std::vector<DrawCommand> commandTemplate;  // instanceCount 0; baseInstance = the command's region
+    size_t objectCount = 0;
+
+    // R32F, each texel the farthest depth of the texels below it. Allocated at the scene
+    // target's capacity; a frame's pyramid fills the lower-left width x height of level 0
+    // (max(size >> level, 1) of each level after it), like the frame fills the target.
+    GLuint pyramid = 0;
+    int capacityWidth = 0, capacityHeight = 0;
+    int width = 0, height = 0, levels = 0;
+    bool pyramidValid = false;  // False until a frame has been rendered into this allocation
+    Mat4 pyramidViewProjection{};
+
+    GLint cullObjectCount = -1, cullFrustum = -1, cullCameraPos = -1, cullLodDistance = -1;
+    GLint cullPyramidViewProjection = -1, cullPyramidSize = -1;
+    GLint copySize = -1, reduceSourceSize = -1, reduceTargetSize = -1;
+
+    // False (and nothing allocated) without GL 4.3; the CPU path is used then
+    bool init() {
+        if (!GLEW_VERSION_4_3) return false;
+        const std::string lodDefine = "#define LOD_COUNT " + std::to_string(MeshLibrary::lodCount) + "u\n";
+        cullProgram = linkComputeProgram(insertDefines(cullSource, lodDefine));
+        copyProgram = linkComputeProgram(copySource);
+        reduceProgram = linkComputeProgram(reduceSource);
+        if (!cullProgram || !copyProgram || !reduceProgram) {
+            destroy();
+            return false;
+        }
+        cullObjectCount = glGetUniformLocation(cullProgram, "uObjectCount");
+        cullFrustum = glGetUniformLocation(cullProgram, "uFrustum");
+        cullCameraPos = glGetUniformLocation(cullProgram, "uCameraPos");
+        cullLodDistance = glGetUniformLocation(cullProgram, "uLodDistance2");
+        cullPyramidViewProjection = glGetUniformLocation(cullProgram, "uHiZViewProjection");
+        cullPyramidSize = glGetUniformLocation(cullProgram, "uHiZSize");
+        glUseProgram(cullProgram);
+        glUniform1i(glGetUniformLocation(cullProgram, "uHiZ"), hizTextureUnit);
+        copySize = glGetUniformLocation(copyProgram, "uSize");
+        reduceSourceSize = glGetUniformLocation(reduceProgram, "uSourceSize");
+        reduceTargetSize = glGetUniformLocation(reduceProgram, "uTargetSize");
+        glUseProgram(copyProgram);
+        glUniform1i(glGetUniformLocation(copyProgram, "uDepth"), hizTextureUnit);
+        glUseProgram(0);
+
+        glGenBuffers(ColumnCount, columns);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &matrixBuffer);
+        glGenBuffers(1, &tintBuffer);
+        supported = true;
+        return true;
+    }
+
+    // Mirror every column and lay out the instance regions: (mesh, LOD) gets room for all of
+    // that mesh's objects, so the shader never has to know how many landed in another LOD
+    void uploadScene(const Scene& scene, const MeshLibrary& library) {
+        objectCount = scene.size();
+        std::vector<GLuint> perMesh(library.meshes.size(), 0);
+        for (uint16_t mesh : scene.meshId) ++perMesh[mesh];
+        commandTemplate.clear();
+        GLuint instances = 0;
+        for (size_t mesh = 0; mesh < library.meshes.size(); ++mesh) {
+            for (int level = 0; level < MeshLibrary::lodCount; ++level) {
+                const MeshLod& range = library.lod(static_cast<uint16_t>(mesh), level);
+                commandTemplate.push_back({static_cast<GLuint>(range.indexCount), 0,
+                                           static_cast<GLuint>(range.firstIndex), range.baseVertex, instances});
+                instances += perMesh[mesh];
+            }
+        }
+
+        storage(columns[Positions], scene.position.data(), objectCount * sizeof(Vec3), GL_STATIC_DRAW);
+        storage(columns[Rotations], scene.rotation.data(), objectCount * sizeof(Vec3), GL_DYNAMIC_DRAW);
+        storage(columns[Scales], scene.scale.data(), objectCount * sizeof(Vec3), GL_STATIC_DRAW);
+        storage(columns[Tints], scene.tint.data(), objectCount * sizeof(Vec3), GL_STATIC_DRAW);
+        storage(columns[Bounds], scene.bounds.data(), objectCount * sizeof(Aabb), GL_STATIC_DRAW);
+        // uint16 ids, read by the shader as pairs packed into uints: round up to whole uints
+        storage(columns[MeshIds], nullptr, (objectCount + 1) / 2 * sizeof(GLuint), GL_STATIC_DRAW);
+        if (objectCount) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objectCount * sizeof(uint16_t), scene.meshId.data());
+        storage(commandBuffer, nullptr, commandTemplate.size() * sizeof(DrawCommand), GL_DYNAMIC_DRAW);
+        storage(matrixBuffer, nullptr, instances * sizeof(Mat4), GL_DYNAMIC_COPY);
+        storage(tintBuffer, nullptr, instances * sizeof(Vec3), GL_DYNAMIC_COPY);
+    }
+
+    // Per-frame updates are staged in the stream ring and copied on the GPU, so they queue
+    // behind the previous frame's reads instead of making the driver wait for or copy them
+    void uploadRotations(const Scene& scene, StreamRing& ring) {
+        copyFromRing(ring, columns[Rotations], scene.rotation.data(), objectCount * sizeof(Vec3));
+    }
+
+    // Reset the counts and run the cull shader; its output is ready for draw-indirect and
+    // vertex fetch once this returns. Props past `hiddenDistance` are fogged out.
+    void cull(StreamRing& ring, const Frustum& frustum, const Vec3& cameraPos, float detailDistance,
+              float hiddenDistance) {
+        copyFromRing(ring, commandBuffer, commandTemplate.data(), commandTemplate.size() * sizeof(DrawCommand));
+        if (objectCount == 0) return;
+        for (GLuint c = 0; c < ColumnCount; ++c) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, c, columns[c]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ColumnCount, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ColumnCount + 1, matrixBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ColumnCount + 2, tintBuffer);
+        glActiveTexture(GL_TEXTURE0 + hizTextureUnit);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+
+        glUseProgram(cullProgram);
+        glUniform1ui(cullObjectCount, static_cast<GLuint>(objectCount));
+        glUniform4fv(cullFrustum, 6, &frustum.planes[0][0]);
+        glUniform3f(cullCameraPos, cameraPos.x, cameraPos.y, cameraPos.z);
+        glUniform2f(cullLodDistance, detailDistance * detailDistance, hiddenDistance * hiddenDistance);
+        glUniformMatrix4fv(cullPyramidViewProjection, 1, GL_FALSE, pyramidViewProjection.m);
+        glUniform3i(cullPyramidSize, width, height, pyramidValid ? levels : 0);
+        glDispatchCompute((static_cast<GLuint>(objectCount) + groupSize - 1) / groupSize, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // Rebuild the pyramid from the lower-left frameWidth x frameHeight texels of `depth`, whose
+    // texture is targetWidth x targetHeight; next frame's cull tests against it. Only a
+    // change of the target's size reallocates, not a dynamic-resolution step.
+    void buildPyramid(GLuint depth, int frameWidth, int frameHeight, int targetWidth, int targetHeight,
+                      const Mat4& viewProjection) {
+        if (frameWidth <= 0 || frameHeight <= 0) return;
+        if (targetWidth != capacityWidth || targetHeight != capacityHeight) allocate(targetWidth, targetHeight);
+        width = std::min(frameWidth, capacityWidth);
+        height = std::min(frameHeight, capacityHeight);
+        levels = levelCount(width, height);
+        glActiveTexture(GL_TEXTURE0 + hizTextureUnit);
+        glBindTexture(GL_TEXTURE_2D, depth);
+
+        glUseProgram(copyProgram);
+        glUniform2i(copySize, width, height);
+        glBindImageTexture(0, pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute(tiles(width), tiles(height), 1);
+        glUseProgram(reduceProgram);
+        for (int level = 1; level < levels; ++level) {
+            int targetW = std::max(width >> level, 1), targetH = std::max(height >> level, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            glUniform2i(reduceSourceSize, std::max(width >> (level - 1), 1), std::max(height >> (level - 1), 1));
+            glUniform2i(reduceTargetSize, targetW, targetH);
+            glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute(tiles(targetW), tiles(targetH), 1);
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        pyramidViewProjection = viewProjection;
+        pyramidValid = true;
+    }
+
+    // The pyramid no longer matches the scene (e.g. frames rendered without rebuilding it);
+    // the next cull skips the occlusion test until buildPyramid runs again
+    void invalidate() { pyramidValid = false; }
+
+    size_t commandCount() const { return commandTemplate.size(); }
+
+    void destroy() {
+        glDeleteProgram(cullProgram);
+        glDeleteProgram(copyProgram);
+        glDeleteProgram(reduceProgram);
+        glDeleteBuffers(ColumnCount, columns);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &matrixBuffer);
+        glDeleteBuffers(1, &tintBuffer);
+        glDeleteTextures(1, &pyramid);
+        cullProgram = copyProgram = reduceProgram = 0;
+        supported = false;
+    }
+
+private:
+    static GLuint tiles(int size) { return (static_cast<GLuint>(size) + tileSize - 1) / tileSize; }
+
+    static void copyFromRing(StreamRing& ring, GLuint target, const void* data, size_t bytes) {
+        if (bytes == 0) return;
+        StreamRing::Allocation staged = ring.push(data, bytes);
+        ring.flush();
+        glBindBuffer(GL_COPY_READ_BUFFER, staged.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, staged.offset, 0, static_cast<GLsizeiptr>(bytes));
+    }
+
+    static void storage(GLuint buffer, const void* data, size_t bytes, GLenum usage) {
+        // Never zero-sized, so binding it stays valid with an empty scene
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(bytes, 16), nullptr, usage);
+        if (data && bytes) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+    }
+
+    static int levelCount(int w, int h) {
+        int count = 1;
+        while ((std::max(w, h) >> count) > 0) ++count;
+        return count;
+    }
+
+    void allocate(int newWidth, int newHeight) {
+        capacityWidth = newWidth;
+        capacityHeight = newHeight;
+        pyramidValid = false;
+        glDeleteTextures(1, &pyramid);
+        glGenTextures(1, &pyramid);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, levelCount(capacityWidth, capacityHeight), GL_R32F, capacityWidth, capacityHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    static constexpr const char* cullSource = R"(
+        #version 430 core
+        layout (local_size_x = 64) in;
+
+        struct DrawCommand {
+            uint count;
+            uint instanceCount;
+            uint firstIndex;
+            int baseVertex;
+            uint baseInstance;
+        };
+
+        // Scene columns, tightly packed floats (std430 would pad a vec3 array to 16 bytes)
+        layout (std430, binding = 0) readonly buffer Positions { float positions[]; };
+        layout (std430, binding = 1) readonly buffer Rotations { float rotations[]; };
+        layout (std430, binding = 2) readonly buffer Scales { float scales[]; };
+        layout (std430, binding = 3) readonly buffer Tints { float tints[]; };
+        layout (std430, binding = 4) readonly buffer Bounds { float bounds[]; };    // min xyz, max xyz
+        layout (std430, binding = 5) readonly buffer MeshIds { uint meshIds[]; };   // Two uint16 per uint
+        layout (std430, binding = 6) buffer Commands { DrawCommand commands[]; };
+        layout (std430, binding = 7) writeonly buffer Matrices { mat4 matrices[]; };
+        layout (std430, binding = 8) writeonly buffer InstanceTints { float instanceTints[]; };
+
+        uniform uint uObjectCount;
+        uniform vec4 uFrustum[6];      // Planes facing inwards: dot(n, p) + d >= 0 inside
+        uniform vec3 uCameraPos;
+        uniform vec2 uLodDistance2;    // Squared distances: x = full detail, y = hidden by fog
+        uniform sampler2D uHiZ;
+        uniform mat4 uHiZViewProjection;  // The frame that rendered the pyramid
+        uniform ivec3 uHiZSize;           // Level 0 size, level count (0 = no pyramid yet)
+
+        #define VEC3(column, i) vec3(column[3u * (i)], column[3u * (i) + 1u], column[3u * (i) + 2u])
+
+        // Whether the box was hidden last frame: project it with that frame's matrix, take the
+        // pyramid level where its screen rectangle covers at most 2x2 texels and compare its
+        // nearest depth with the farthest depth stored there
+        bool occluded(vec3 boxMin, vec3 boxMax) {
+            if (uHiZSize.z == 0) return false;
+            vec2 ndcMin = vec2(1e30), ndcMax = vec2(-1e30);
+            float nearest = 1.0;
+            for (int c = 0; c < 8; ++c) {
+                vec3 corner = vec3((c & 1) != 0 ? boxMax.x : boxMin.x, (c & 2) != 0 ? boxMax.y : boxMin.y,
+                                   (c & 4) != 0 ? boxMax.z : boxMin.z);
+                vec4 clip = uHiZViewProjection * vec4(corner, 1.0);
+                if (clip.w <= 0.0) return false;  // Reaches behind the camera: keep it
+                vec3 ndc = clip.xyz / clip.w;
+                ndcMin = min(ndcMin, ndc.xy);
+                ndcMax = max(ndcMax, ndc.xy);
+                nearest = min(nearest, ndc.z * 0.5 + 0.5);
+            }
+            if (any(greaterThan(ndcMin, vec2(1.0))) || any(lessThan(ndcMax, vec2(-1.0)))) return false;  // Off screen then
+
+            ivec2 size = uHiZSize.xy;
+            ivec2 p0 = clamp(ivec2((ndcMin * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+            ivec2 p1 = clamp(ivec2((ndcMax * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+            int level = min(findMSB(max(p1.x - p0.x, p1.y - p0.y)) + 1, uHiZSize.z - 1);
+            // A level texel covers the texels below it (the last row/column also the odd remainder)
+            ivec2 last = max(size >> level, ivec2(1)) - 1;
+            p0 = min(p0 >> level, last);
+            p1 = min(p1 >> level, last);
+            float farthest = max(max(texelFetch(uHiZ, p0, level).r, texelFetch(uHiZ, ivec2(p1.x, p0.y), level).r),
+                                 max(texelFetch(uHiZ, ivec2(p0.x, p1.y), level).r, texelFetch(uHiZ, p1, level).r));
+            return nearest > farthest;
+        }
+
+        void main() {
+            uint i = gl_GlobalInvocationID.x;
+            if (i >= uObjectCount) return;
+            vec3 boxMin = VEC3(bounds, 2u * i);
+            vec3 boxMax = VEC3(bounds, 2u * i + 1u);
+            for (int p = 0; p < 6; ++p) {
+                // Corner furthest along the plane normal, as in cullAabb
+                vec3 corner = mix(boxMin, boxMax, step(0.0, uFrustum[p].xyz));
+                if (dot(uFrustum[p].xyz, corner) + uFrustum[p].w < 0.0) return;
+            }
+            vec3 t = VEC3(positions, i);
+            vec3 toCamera = t - uCameraPos;
+            float dist2 = dot(toCamera, toCamera);
+            if (dist2 > uLodDistance2.y || occluded(boxMin, boxMax)) return;
+
+            uint level = dist2 <= uLodDistance2.x ? 0u : LOD_COUNT - 1u;
+            uint mesh = (meshIds[i >> 1] >> ((i & 1u) * 16u)) & 0xFFFFu;
+            uint command = mesh * LOD_COUNT + level;
+            uint slot = commands[command].baseInstance + atomicAdd(commands[command].instanceCount, 1u);
+
+            // Same closed-form TRS as composeTransforms: columns of Ry * Rx * Rz, scaled
+            vec3 a = VEC3(rotations, i);
+            vec3 s = VEC3(scales, i);
+            float sx = sin(a.x), cx = cos(a.x);
+            float sy = sin(a.y), cy = cos(a.y);
+            float sz = sin(a.z), cz = cos(a.z);
+            matrices[slot] = mat4(vec4(vec3(cy * cz + sy * sx * sz, cx * sz, -sy * cz + cy * sx * sz) * s.x, 0.0),
+                                  vec4(vec3(-cy * sz + sy * sx * cz, cx * cz, sy * sz + cy * sx * cz) * s.y, 0.0),
+                                  vec4(vec3(sy * cx, -sx, cy * cx) * s.z, 0.0),
+                                  vec4(t, 1.0));
+            vec3 tint = VEC3(tints, i);
+            instanceTints[3u * slot] = tint.r;
+            instanceTints[3u * slot + 1u] = tint.g;
+            instanceTints[3u * slot + 2u] = tint.b;
+        }
+    )";
+
+    static constexpr const char* copySource = R"(
+        #version 430 core
+        layout (local_size_x = 8, local_size_y = 8) in;
+        uniform sampler2D uDepth;
+        uniform ivec2 uSize;  // The frame's part of the target
+        layout (r32f, binding = 0) writeonly uniform image2D uTarget;
+
+        void main() {
+            ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+            if (any(greaterThanEqual(p, uSize))) return;
+            imageStore(uTarget, p, vec4(texelFetch(uDepth, p, 0).r));
+        }
+    )";
+
+    static constexpr const char* reduceSource = R"(
+        #version 430 core
+        layout (local_size_x = 8, local_size_y = 8) in;
+        layout (r32f, binding = 0) readonly uniform image2D uSource;
+        layout (r32f, binding = 1) writeonly uniform image2D uTarget;
+        uniform ivec2 uSourceSize, uTargetSize;  // Used parts of the two levels, not their allocation
+
+        // Farthest of the 2x2 texels below; on an odd-sized source the last row and column
+        // also take the leftover texels, so every source texel is covered
+        void main() {
+            ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+            ivec2 size = uTargetSize;
+            if (any(greaterThanEqual(p, size))) return;
+            ivec2 sourceSize = uSourceSize;
+            ivec2 last = min(p * 2 + 1 + ivec2(equal(p, size - 1)) * (sourceSize & 1), sourceSize - 1);
+            float farthest = 0.0;
+            for (int y = p.y * 2; y <= last.y; ++y) {
+                for (int x = p.x * 2; x <= last.x; ++x) farthest = max(farthest, imageLoad(uSource, ivec2(x, y)).r);
+            }
+            imageStore(uTarget, p, vec4(farthest));
+        }
+    )";
+};
+
+// Offscreen HDR scene target: R11F_G11F_B10F color (4 bytes per pixel, no alpha) and a depth
+// texture the Hi-Z pass samples directly. Allocated at the window size; dynamic resolution
+// renders into its lower-left corner, so a scale change is only a viewport change.
+struct SceneTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    int capacityWidth = 0, capacityHeight = 0;
+
+    void resize(int width, int height) {
+        if (width == capacityWidth && height == capacityHeight) return;
+        capacityWidth = width;
+        capacityHeight = height;
+        if (!fbo) glGenFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteTextures(1, &depth);
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT,
+                     nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Scene framebuffer incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroy() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteTextures(1, &depth);
+    }
+};
+
+// Render-resolution controller. GPU frame times arrive a few frames late (timer queries are
+// read without stalling), so the scale moves at most once per settle period, only when the
+// time is over the target or well under it, and by the square root of the time ratio
+// (cost follows pixel count, the square of the per-axis scale), limited per step.
+struct DynamicResolution {
+    static constexpr float minScale = 0.5f, maxScale = 1.0f;
+    static constexpr float step = 1.0f / 32.0f;   // Scales are multiples of this, so small timing noise never moves them
+    static constexpr float maxChange = 0.15f;     // Largest per-step change, relative
+    static const int settleFrames = Profiler::gpuFramesInFlight + 2;
+
+    float targetMs = 0.0f;  // <= 0: always native resolution
+    float scale = 1.0f;
+    int framesSinceChange = 0;
+
+    void update(double gpuMs) {
+        if (targetMs <= 0.0f) {
+            scale = 1.0f;
+            return;
+        }
+        if (++framesSinceChange < settleFrames || gpuMs <= 0.0) return;
+        if (gpuMs <= targetMs && gpuMs >= 0.8 * targetMs) return;  // Within budget: don't chase noise
+        float wanted = scale * static_cast<float>(std::sqrt(0.9 * targetMs / gpuMs));
+        wanted = clamp(wanted, scale * (1.0f - maxChange), scale * (1.0f + maxChange));
+        wanted = clamp(std::round(wanted / step) * step, minScale, maxScale);
+        if (wanted != scale) {
+            scale = wanted;
+            framesSinceChange = 0;
+        }
+    }
+
+    int scaled(int size) const { return std::max(1, static_cast<int>(static_cast<float>(size) * scale + 0.5f)); }
+};
+
+// Block-compressed image with a pre-built mip chain, as read from a DDS or KTX2 file.
+// Every supported format uses 4x4 texel blocks.
+struct CompressedImage {
+    struct Level {
+        size_t offset;  // Into the file while parsing, into the staging block once copied
+        size_t size;
+        int width, height;
+    };
+    GLenum format = 0;
+    int blockBytes = 0;
+    std::vector<Level> levels;
+};
+
+static size_t compressedLevelSize(int width, int height, int blockBytes) {
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * static_cast<size_t>(blockBytes);
+}
+
+static int compressedBlockBytes(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+            return 8;
+        default:
+            return 16;  // BC3, BC7, ETC2+EAC, ASTC 4x4
+    }
+}
+
+static bool compressedFormatSupported(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return GLEW_EXT_texture_compression_s3tc;
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            return GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+        case GL_COMPRESSED_RGBA_ASTC_4x4_KHR:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR:
+            return GLEW_KHR_texture_compression_astc_ldr;
+        default:
+            return false;
+    }
+}
+
+// Albedo is authored in sRGB: sampling it through an sRGB format decodes it to the linear
+// space the HDR target is lit in. Formats without an sRGB twin come back unchanged.
+static GLenum srgbFormat(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+        case GL_COMPRESSED_RGB8_ETC2: return GL_COMPRESSED_SRGB8_ETC2;
+        case GL_COMPRESSED_RGBA8_ETC2_EAC: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+        case GL_COMPRESSED_RGBA_ASTC_4x4_KHR: return GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR;
+        default: return format;
+    }
+}
+
+template <typename T>
+static T readLittle(const std::vector<uint8_t>& file, size_t offset) {
+    T value{};
+    if (offset + sizeof(T) <= file.size()) std::memcpy(&value, file.data() + offset, sizeof(T));
+    return value;
+}
+
+// Fill levels[] for a mip chain stored back to back from `offset`, largest first
+static bool layoutMipChain(const std::vector<uint8_t>& file, size_t offset, int width, int height, int levelCount,
+                           CompressedImage& image) {
+    image.blockBytes = compressedBlockBytes(image.format);
+    for (int level = 0; level < std::max(levelCount, 1); ++level) {
+        size_t size = compressedLevelSize(width, height, image.blockBytes);
+        if (offset + size > file.size()) return false;
+        image.levels.push_back({offset, size, width, height});
+        offset += size;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+// DDS: legacy FourCC (DXT1/DXT5) or DX10 extended header (BC1/BC3/BC7 DXGI formats)
+static bool parseDds(const std::vector<uint8_t>& file, CompressedImage& image) {
+    if (file.size() < 128 || std::memcmp(file.data(), "DDS ", 4) != 0 || readLittle<uint32_t>(file, 4) != 124) return false;
+    int height = static_cast<int>(readLittle<uint32_t>(file, 12));
+    int width = static_cast<int>(readLittle<uint32_t>(file, 16));
+    int levels = static_cast<int>(readLittle<uint32_t>(file, 28));
+    const uint32_t fourCCFlag = 0x4;
+    if (!(readLittle<uint32_t>(file, 80) & fourCCFlag) || width <= 0 || height <= 0) return false;
+    char fourCC[4];
+    std::memcpy(fourCC, file.data() + 84, 4);
+    size_t dataOffset = 128;
+    if (std::memcmp(fourCC, "DXT1", 4) == 0) {
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    } else if (std::memcmp(fourCC, "DXT5", 4) == 0) {
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    } else if (std::memcmp(fourCC, "DX10", 4) == 0) {
+        dataOffset = 148;
+        switch (readLittle<uint32_t>(file, 128)) {
+            case 71: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+            case 72: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;
+            case 77: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+            case 78: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;
+            case 98: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+            case 99: image.format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;
+            default: return false;
+        }
+    } else {
+        return false;
+    }
+    return layoutMipChain(file, dataOffset, width, height, levels, image);
+}
+
+// KTX2: single-face 2D textures without supercompression (BC1/BC3/BC7/ETC2/ASTC 4x4)
+static bool parseKtx2(const std::vector<uint8_t>& file, CompressedImage& image) {
+    static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    if (file.size() < 80 || std::memcmp(file.data(), identifier, sizeof(identifier)) != 0) return false;
+    uint32_t vkFormat = readLittle<uint32_t>(file, 12);
+    int width = static_cast<int>(readLittle<uint32_t>(file, 20));
+    int height = static_cast<int>(readLittle<uint32_t>(file, 24));
+    bool flat = readLittle<uint32_t>(file, 28) == 0 && readLittle<uint32_t>(file, 32) <= 1 && readLittle<uint32_t>(file, 36) == 1;
+    int levels = std::max(static_cast<int>(readLittle<uint32_t>(file, 40)), 1);
+    if (!flat || readLittle<uint32_t>(file, 44) != 0 || width <= 0 || height <= 0) return false;
+    switch (vkFormat) {
+        case 131: image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+        case 132: image.format = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT; break;
+        case 133: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+        case 134: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;
+        case 137: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+        case 138: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;
+        case 145: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+        case 146: image.format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;
+        case 147: image.format = GL_COMPRESSED_RGB8_ETC2; break;
+        case 148: image.format = GL_COMPRESSED_SRGB8_ETC2; break;
+        case 151: image.format = GL_COMPRESSED_RGBA8_ETC2_EAC; break;
+        case 152: image.format = GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC; break;
+        case 157: image.format = GL_COMPRESSED_RGBA_ASTC_4x4_KHR; break;
+        case 158: image.format = GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR; break;
+        default: return false;
+    }
+    image.blockBytes = compressedBlockBytes(image.format);
+    // Level index (offset, length, uncompressed length as u64) follows the 80-byte header
+    for (int level = 0; level < levels; ++level) {
+        size_t entry = 80 + static_cast<size_t>(level) * 24;
+        size_t offset = static_cast<size_t>(readLittle<uint64_t>(file, entry));
+        size_t size = static_cast<size_t>(readLittle<uint64_t>(file, entry + 8));
+        int w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+        if (entry + 24 > file.size() || size != compressedLevelSize(w, h, image.blockBytes) || offset + size > file.size()) {
+            return false;
+        }
+        image.levels.push_back({offset, size, w, h});
+    }
+    return true;
+}
+
+static uint16_t packRgb565(int r, int g, int b) {
+    return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void unpackRgb565(uint16_t c, int rgb[3]) {
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+// BC1 (opaque, 4-colour mode) encoder for one 4x4 RGBA8 block: endpoints from the inset
+// bounding box, oriented along the dominant channel's correlation, then nearest-colour indices
+static void encodeBc1Block(const uint8_t* rgba, uint8_t* out) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], static_cast<int>(rgba[i * 4 + c]));
+            hi[c] = std::max(hi[c], static_cast<int>(rgba[i * 4 + c]));
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+        }
+    }
+    int major = 0;
+    for (int c = 1; c < 3; ++c) {
+        if (hi[c] - lo[c] > hi[major] - lo[major]) major = c;
+    }
+    for (int c = 0; c < 3; ++c) {
+        float covariance = 0.0f;
+        for (int i = 0; i < 16; ++i) covariance += (rgba[i * 4 + c] - mean[c]) * (rgba[i * 4 + major] - mean[major]);
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+        if (covariance < 0.0f) std::swap(lo[c], hi[c]);
+    }
+    uint16_t c0 = packRgb565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = packRgb565(lo[0], lo[1], lo[2]);
+    if (c0 < c1) std::swap(c0, c1);  // c0 > c1 selects the 4-colour mode
+
+    int palette[4][3];
+    unpackRgb565(c0, palette[0]);
+    unpackRgb565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 4; ++p) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = rgba[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// Encode an RGBA8 image as BC1; edge blocks replicate the last row/column
+static void encodeBc1(const uint8_t* rgba, int width, int height, uint8_t* out) {
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            uint8_t block[64];
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) {
+                    int sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, rgba + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+                }
+            }
+            encodeBc1Block(block, out);
+            out += 8;
+        }
+    }
+}
+
+// 2x2 box filter for the next mip level (odd sizes reuse the last row/column)
+static std::vector<uint8_t> downsampleRgba(const std::vector<uint8_t>& rgba, int width, int height) {
+    int w = std::max(width / 2, 1), h = std::max(height / 2, 1);
+    std::vector<uint8_t> out(static_cast<size_t>(w) * h * 4);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c] +
+                          rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                out[(static_cast<size_t>(y) * w + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return out;
+}
+
+// Pre-bake a full BC1 mip chain (down to 1x1) from an RGBA8 image into `data`
+static CompressedImage bakeBc1MipChain(std::vector<uint8_t> rgba, int width, int height, std::vector<uint8_t>& data) {
+    CompressedImage image;
+    image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    image.blockBytes = 8;
+    data.clear();
+    while (true) {
+        size_t size = compressedLevelSize(width, height, image.blockBytes);
+        image.levels.push_back({data.size(), size, width, height});
+        data.resize(data.size() + size);
+        encodeBc1(rgba.data(), width, height, data.data() + image.levels.back().offset);
+        if (width == 1 && height == 1) break;
+        rgba = downsampleRgba(rgba, width, height);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return image;
+}
+
+// Write a BC1 mip chain as a legacy DXT1 DDS file
+static bool writeDds(const std::string& path, const CompressedImage& image, const std::vector<uint8_t>& data) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out || image.levels.empty()) return false;
+    uint32_t header[32] = {};
+    std::memcpy(&header[0], "DDS ", 4);
+    header[1] = 124;                                        // Header size
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;  // Caps, height, width, pixel format, mip count, linear size
+    header[3] = static_cast<uint32_t>(image.levels[0].height);
+    header[4] = static_cast<uint32_t>(image.levels[0].width);
+    header[5] = static_cast<uint32_t>(image.levels[0].size);
+    header[7] = static_cast<uint32_t>(image.levels.size());
+    header[19] = 32;   // Pixel format size
+    header[20] = 0x4;  // FourCC
+    std::memcpy(&header[21], "DXT1", 4);
+    header[27] = 0x1000 | 0x8 | 0x400000;  // Texture, complex, mipmap
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+// Upload one mip level with glCompressedTexImage2D; `base` is a client address, or an
+// offset into the bound pixel-unpack buffer
+static void uploadCompressedLevel(const CompressedImage& image, int level, uintptr_t base) {
+    const CompressedImage::Level& l = image.levels[static_cast<size_t>(level)];
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height, 0, static_cast<GLsizei>(l.size),
+                           reinterpret_cast<const void*>(base + l.offset));
+}
+
+// Fixed-size staging ring for texture uploads. Blocks are carved off the head in request
+// order and retired from the tail once the GPU passes the fence recorded after their last
+// glTexSubImage; with GL_ARB_buffer_storage the ring is a persistently mapped pixel-unpack
+// buffer so workers decode straight into memory the driver reads from, otherwise it is
+// plain client memory passed to glTexSubImage directly. Only the GL thread allocates/retires.
+struct StagingRing {
+    struct Block {
+        size_t offset, size;
+        GLsync fence;  // Null until the uploads reading this block have been issued
+        bool padding;  // Unused tail of the ring skipped by a wrapping allocation
+    };
+
+    GLuint pbo = 0;
+    uint8_t* memory = nullptr;
+    std::vector<uint8_t> clientMemory;  // Used when persistent mapping is unavailable
+    size_t capacity = 0, head = 0, used = 0;
+    std::deque<Block> blocks;
+    size_t retired = 0;  // Blocks popped so far; keeps block ids stable
+
+    void init(size_t bytes) {
+        capacity = bytes;
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, flags);
+            memory = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), flags));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (!memory) {
+                glDeleteBuffers(1, &pbo);
+                pbo = 0;
+            }
+        }
+        if (!memory) {
+            clientMemory.resize(bytes);
+            memory = clientMemory.data();
+        }
+    }
+
+    // Returns a block id, or -1 if `size` contiguous bytes aren't free right now
+    int allocate(size_t size) {
+        size = (size + 255) & ~size_t(255);
+        if (size > capacity) return -1;
+        if (used == 0) head = 0;
+        size_t offset = head + size > capacity ? 0 : head;
+        size_t waste = offset == head ? 0 : capacity - head;
+        if (used + waste + size > capacity) return -1;
+        if (waste > 0) blocks.push_back({head, waste, nullptr, true});
+        blocks.push_back({offset, size, nullptr, false});
+        used += waste + size;
+        head = offset + size;
+        return static_cast<int>(retired + blocks.size() - 1);
+    }
+
+    Block& block(int id) { return blocks[static_cast<size_t>(id) - retired]; }
+
+    // Free blocks from the tail whose uploads the GPU has consumed
+    void retire() {
+        while (!blocks.empty()) {
+            Block& tail = blocks.front();
+            if (!tail.padding) {
+                if (!tail.fence || glClientWaitSync(tail.fence, 0, 0) == GL_TIMEOUT_EXPIRED) return;
+                glDeleteSync(tail.fence);
+            }
+            used -= tail.size;
+            blocks.pop_front();
+            ++retired;
+        }
+    }
+
+    void destroy() {
+        for (Block& b : blocks) {
+            if (b.fence) glDeleteSync(b.fence);
+        }
+        blocks.clear();
+        if (pbo) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &pbo);
+            pbo = 0;
+        }
+        memory = nullptr;
+    }
+};
+
+// Binary PPM (P6, 8-bit) header parser; returns the offset of the pixel data or 0 on error
+static size_t parsePpmHeader(const std::vector<uint8_t>& file, int& width, int& height) {
+    size_t pos = 0;
+    auto token = [&]() -> std::string {
+        std::string t;
+        while (pos < file.size()) {
+            char c = static_cast<char>(file[pos]);
+            if (c == '#') {
+                while (pos < file.size() && file[pos] != '\n') ++pos;
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                if (!t.empty()) break;
+                ++pos;
+            } else {
+                t += c;
+                ++pos;
+            }
+        }
+        return t;
+    };
+    if (token() != "P6") return 0;
+    width = std::atoi(token().c_str());
+    height = std::atoi(token().c_str());
+    int maxValue = std::atoi(token().c_str());
+    ++pos;  // Single whitespace byte before the raster
+    if (width <= 0 || height <= 0 || maxValue != 255) return 0;
+    if (file.size() < pos + static_cast<size_t>(width) * static_cast<size_t>(height) * 3) return 0;
+    return pos;
+}
+
+// Streams textures from disk without blocking the frame. Each request goes through:
+//   1. read + parse header on a worker (size becomes known)
+//   2. GL thread reserves staging-ring space; a worker decodes to RGBA8 (PPM) or copies
+//      the pre-built mip chain (DDS/KTX2 block-compressed) straight into it
+//   3. GL thread uploads from the ring within a per-frame time budget: glTexSubImage2D
+//      row bands, or one glCompressedTexImage2D per mip level
+//   4. after the last upload: mipmaps (PPM only), then a fence; ready when it signals
+// Until then texture() hands out the caller's fallback, so draws never wait on I/O.
+struct AssetLoader {
+    enum class State { Reading, Decoding, Uploading, Fenced, Ready, Failed };
+
+    struct Texture {
+        std::string path;
+        std::atomic<State> state{State::Reading};
+        GLuint id = 0;
+        int width = 0, height = 0;
+        std::vector<uint8_t> file;  // Raw file bytes between read and decode
+        size_t pixelOffset = 0;
+        bool compressed = false;
+        CompressedImage image;  // Block-compressed files: format and mip levels
+        int stagingBlock = -1;
+        int rowsUploaded = 0;   // Or mip levels uploaded, for compressed textures
+        GLsync fence = nullptr;
+        bool reported = false;  // Failure already logged
+        JobCounter job;
+    };
+
+    static constexpr int bandRows = 64;  // Rows per glTexSubImage2D call
+
+    StagingRing ring;
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::deque<Texture*> waitingForStaging;  // Decoded in order, so big textures can't be starved
+
+    void init(size_t stagingBytes = 32u << 20) { ring.init(stagingBytes); }
+
+    uint32_t requestTexture(const std::string& path, JobSystem& jobs) {
+        textures.push_back(std::make_unique<Texture>());
+        Texture* tex = textures.back().get();
+        tex->path = path;
+        jobs.submit([tex]() {
+            std::ifstream in(tex->path, std::ios::binary);
+            if (in) tex->file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            if (parseDds(tex->file, tex->image) || parseKtx2(tex->file, tex->image)) {
+                tex->compressed = true;
+                tex->width = tex->image.levels[0].width;
+                tex->height = tex->image.levels[0].height;
+                return;
+            }
+            tex->image = CompressedImage{};
+            tex->pixelOffset = parsePpmHeader(tex->file, tex->width, tex->height);
+            if (tex->pixelOffset == 0) tex->state = State::Failed;
+        }, &tex->job);
+        return static_cast<uint32_t>(textures.size() - 1);
+    }
+
+    GLuint texture(uint32_t handle, GLuint fallback) const {
+        const Texture& tex = *textures[handle];
+        return tex.state == State::Ready ? tex.id : fallback;
+    }
+
+    static size_t stagingSize(const Texture& tex) {
+        if (tex.compressed) {
+            size_t total = 0;
+            for (const auto& level : tex.image.levels) total += level.size;
+            return total;
+        }
+        return static_cast<size_t>(tex.width) * static_cast<size_t>(tex.height) * 4;
+    }
+
+    // Advance every request one step; GL uploads stop once `budgetMs` of this call is used
+    void update(JobSystem& jobs, double budgetMs) {
+        double start = nowSeconds();
+        ring.retire();
+
+        for (auto& owned : textures) {
+            Texture& tex = *owned;
+            if (!tex.job.done()) continue;
+            State state = tex.state;
+            if (state == State::Reading && tex.compressed && !compressedFormatSupported(tex.image.format)) {
+                std::cerr << "No GPU support for the compression format of " << tex.path << std::endl;
+                std::vector<uint8_t>().swap(tex.file);
+                tex.state = State::Failed;
+                tex.reported = true;
+            } else if (state == State::Reading) {
+                // Every streamed texture is albedo, so UNORM-tagged files are read as sRGB too
+                if (tex.compressed && compressedFormatSupported(srgbFormat(tex.image.format))) {
+                    tex.image.format = srgbFormat(tex.image.format);
+                }
+                tex.state = State::Decoding;
+                waitingForStaging.push_back(&tex);
+            } else if (state == State::Failed && !tex.reported) {
+                std::cerr << "Failed to load texture " << tex.path << " (expected DDS, KTX2 or binary 8-bit PPM)" << std::endl;
+                std::vector<uint8_t>().swap(tex.file);
+                tex.reported = true;
+            } else if (state == State::Fenced && glClientWaitSync(tex.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+                glDeleteSync(tex.fence);
+                tex.fence = nullptr;
+                tex.state = State::Ready;
+            }
+        }
+
+        // Reserve staging in request order and hand decoding to the workers
+        while (!waitingForStaging.empty()) {
+            Texture& tex = *waitingForStaging.front();
+            if (stagingSize(tex) > ring.capacity) {
+                std::cerr << "Texture " << tex.path << " is larger than the staging ring" << std::endl;
+                std::vector<uint8_t>().swap(tex.file);
+                tex.state = State::Failed;
+                tex.reported = true;
+                waitingForStaging.pop_front();
+                continue;
+            }
+            int block = ring.allocate(stagingSize(tex));
+            if (block < 0) break;
+            tex.stagingBlock = block;
+            uint8_t* dst = ring.memory + ring.block(block).offset;
+            waitingForStaging.pop_front();
+            jobs.submit([&tex, dst]() {
+                if (tex.compressed) {
+                    // Pack the levels back to back; offsets become relative to the staging block
+                    size_t cursor = 0;
+                    for (auto& level : tex.image.levels) {
+                        std::memcpy(dst + cursor, tex.file.data() + level.offset, level.size);
+                        level.offset = cursor;
+                        cursor += level.size;
+                    }
+                    std::vector<uint8_t>().swap(tex.file);
+                    tex.state = State::Uploading;
+                    return;
+                }
+                const uint8_t* src = tex.file.data() + tex.pixelOffset;
+                size_t pixels = static_cast<size_t>(tex.width) * static_cast<size_t>(tex.height);
+                for (size_t i = 0; i < pixels; ++i) {
+                    dst[i * 4 + 0] = src[i * 3 + 0];
+                    dst[i * 4 + 1] = src[i * 3 + 1];
+                    dst[i * 4 + 2] = src[i * 3 + 2];
+                    dst[i * 4 + 3] = 255;
+                }
+                std::vector<uint8_t>().swap(tex.file);
+                tex.state = State::Uploading;
+            }, &tex.job);
+        }
+
+        // Time-sliced uploads out of the ring
+        if (ring.pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.pbo);
+        for (auto& owned : textures) {
+            Texture& tex = *owned;
+            if (!tex.job.done() || tex.state != State::Uploading) continue;
+            if (tex.id == 0) {
+                glGenTextures(1, &tex.id);
+                glBindTexture(GL_TEXTURE_2D, tex.id);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                if (tex.compressed) {
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(tex.image.levels.size()) - 1);
+                } else {
+                    // Storage only: with the ring bound as the unpack buffer, null would mean "offset 0 of the ring"
+                    if (ring.pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, tex.width, tex.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                    if (ring.pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.pbo);
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D, tex.id);
+            StagingRing::Block& block = ring.block(tex.stagingBlock);
+            if (tex.compressed) {
+                // Mip chain is pre-built: one upload per level, no glGenerateMipmap
+                int levelCount = static_cast<int>(tex.image.levels.size());
+                uintptr_t base = (ring.pbo ? 0 : reinterpret_cast<uintptr_t>(ring.memory)) + block.offset;
+                while (tex.rowsUploaded < levelCount && (nowSeconds() - start) * 1000.0 < budgetMs) {
+                    uploadCompressedLevel(tex.image, tex.rowsUploaded, base);
+                    ++tex.rowsUploaded;
+                }
+                if (tex.rowsUploaded == levelCount) {
+                    tex.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    block.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    tex.state = State::Fenced;
+                }
+                if ((nowSeconds() - start) * 1000.0 >= budgetMs) break;
+                continue;
+            }
+            while (tex.rowsUploaded < tex.height && (nowSeconds() - start) * 1000.0 < budgetMs) {
+                int rows = std::min(bandRows, tex.height - tex.rowsUploaded);
+                size_t offset = block.offset + static_cast<size_t>(tex.rowsUploaded) * static_cast<size_t>(tex.width) * 4;
+                const void* source = ring.pbo ? (const void*)offset : (const void*)(ring.memory + offset);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tex.rowsUploaded, tex.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, source);
+                tex.rowsUploaded += rows;
+            }
+            if (tex.rowsUploaded == tex.height) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+                tex.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                block.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                tex.state = State::Fenced;
+            }
+            if ((nowSeconds() - start) * 1000.0 >= budgetMs) break;
+        }
+        if (ring.pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    void destroy(JobSystem& jobs) {
+        for (auto& tex : textures) {
+            jobs.wait(tex->job);
+            if (tex->fence) glDeleteSync(tex->fence);
+            if (tex->id) glDeleteTextures(1, &tex->id);
+        }
+        textures.clear();
+        ring.destroy();
+    }
+};
+
+// Input sampled on the main thread and consumed by the simulation
+struct PlayerInput {
+    Vec3 move{0.0f, 0.0f, 0.0f};  // Horizontal world-space direction, unit length or zero
+    bool jump = false;            // Jump key held
+};
+
+struct PlayerState {
+    Vec3 position{0.0f, 0.6f, 4.0f};  // Eye position; starts at ground + playerHeight
+    float velocityY = 0.0f;
+    bool grounded = false;
+};
+
+// Static prop colliders owned by the simulation, indexed by scene handle slot
+struct CollisionWorld {
+    SpatialGrid grid;
+    std::vector<Aabb> colliders;
+};
+
+static CollisionWorld buildCollisionWorld(const Scene& scene) {
+    CollisionWorld world;
+    world.colliders.resize(scene.slots.size());
+    for (size_t i = 0; i < scene.size(); ++i) {
+        world.colliders[scene.slotOf[i]] = scene.collider[i];
+        world.grid.insert(scene.slotOf[i], scene.collider[i]);
+    }
+    return world;
+}
+
+// Advance the player by one fixed step; per-step scratch lists come from `scratch`
+static PlayerState stepPlayer(PlayerState state, const PlayerInput& input, float dt, CollisionWorld& world,
+                              FrameArena& scratch) {
+    // Apply horizontal movement with collision detection
+    if (dot(input.move, input.move) > 0.0f) {
+        Vec3 nextPos = add(state.position, mul(input.move, cameraSpeed * dt));
+
+        // Broadphase: only props in the cells the swept sphere overlaps
+        Vec3 reach{cameraRadius, cameraRadius, cameraRadius};
+        const Vec3& p = state.position;
+        Aabb swept{sub({std::min(p.x, nextPos.x), std::min(p.y, nextPos.y), std::min(p.z, nextPos.z)}, reach),
+                   add({std::max(p.x, nextPos.x), std::max(p.y, nextPos.y), std::max(p.z, nextPos.z)}, reach)};
+        FrameVector<uint32_t> candidates(scratch);
+        candidates.reserve(64);
+        world.grid.query(swept, candidates);
+
+        bool collided = false;
+        for (uint32_t slot : candidates) {
+            const Aabb& box = world.colliders[slot];
+            if (sphereAabbCollision(nextPos, cameraRadius, box.min, box.max)) {
+                collided = true;
+                break;
+            }
+        }
+        if (!collided) {
+            state.position = nextPos;
+        }
+    }
+
+    // Jump input (only when grounded)
+    if (input.jump && state.grounded) {
+        state.velocityY = jumpSpeed;
+        state.grounded = false;
+    }
+
+    // Apply gravity to vertical velocity, then velocity to position
+    state.velocityY += gravity * dt;
+    state.position.y += state.velocityY * dt;
+
+    // Ground collision against the terrain heightfield - feet are at position.y - playerHeight.
+    // While walking, small drops stay snapped to the surface so downhill steps don't count as falls.
+    const float stepDown = 0.3f;
+    float groundY = terrainHeight(state.position.x, state.position.z);
+    float feetY = state.position.y - playerHeight;
+    if (feetY <= groundY || (state.grounded && state.velocityY <= 0.0f && feetY - groundY < stepDown)) {
+        state.position.y = groundY + playerHeight;
+        state.velocityY = 0.0f;
+        state.grounded = true;
+    } else {
+        state.grounded = false;
+    }
+    return state;
+}
+
+// Fixed-step simulation on its own thread. The render thread publishes input and
+// reads back the last two states, interpolating between them so rendering runs at
+// display rate while physics advances in exact simTimestep increments.
+struct Simulation {
+    CollisionWorld world;
+    FrameArena stepArena{64 << 10};  // Reset every step; only touched by the worker
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::mutex mutex;            // Guards everything below
+    PlayerInput input;
+    PlayerState previous;
+    PlayerState current;
+    double currentTickTime = 0.0;  // Wall time at which `current` became the latest state
+
+    void start(const PlayerState& initial) {
+        previous = current = initial;
+        currentTickTime = nowSeconds();
+        running = true;
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        running = false;
+        if (worker.joinable()) worker.join();
+    }
+
+    void setInput(const PlayerInput& newInput) {
+        std::lock_guard<std::mutex> lock(mutex);
+        input = newInput;
+    }
+
+    void run() {
+        Profiler::threadTrack() = 100;  // Own row in traces, clear of the job workers
+        double nextTick = nowSeconds() + simTimestep;
+        PlayerState state;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            state = current;
+        }
+        while (running) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(nextTick))));
+            // Catch up on every step that is due; after a long stall, drop the backlog rather than spiral
+            double now = nowSeconds();
+            if (now - nextTick > 0.25) nextTick = now;
+            while (nextTick <= now) {
+                PlayerInput stepInput;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stepInput = input;
+                }
+                PlayerState next;
+                {
+                    ProfileScope scope("physics step");
+                    stepArena.reset();
+                    next = stepPlayer(state, stepInput, static_cast<float>(simTimestep), world, stepArena);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    previous = state;
+                    current = next;
+                    currentTickTime = nextTick;
+                }
+                state = next;
+                nextTick += simTimestep;
+            }
+        }
+    }
+
+    // Render-side view of the player at `time`, one step behind the newest state
+    Vec3 interpolatedPosition(double time) {
+        std::lock_guard<std::mutex> lock(mutex);
+        float alpha = clamp(static_cast<float>((time - currentTickTime) / simTimestep), 0.0f, 1.0f);
+        return add(mul(previous.position, 1.0f - alpha), mul(current.position, alpha));
+    }
+};
 
 static void mouseCallback(GLFWwindow* window, double xposIn, double yposIn) {
     float xpos = static_cast<float>(xposIn);
@@ -191,6 +4893,7 @@ static void mouseCallback(GLFWwindow* window, double xposIn, double yposIn) {
         lastX = xpos;
         lastY = ypos;
         firstMouse = false;
+        return;
     }
 
     float xoffset = xpos - lastX;
@@ -198,13 +4901,29 @@ static void mouseCallback(GLFWwindow* window, double xposIn, double yposIn) {
     lastX = xpos;
     lastY = ypos;
 
+    // Only accumulate here; applyMouseLook() turns the camera once the frame's poll is done.
+    // Callbacks run inside glfwPollEvents, so the event itself arrived at some point after the
+    // previous poll: that time is the conservative (earliest) arrival the latency is measured from.
     float sensitivity = 0.1f;
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
+    pendingLookX += xoffset * sensitivity;
+    pendingLookY += yoffset * sensitivity;
+    if (pendingLookSinceMs < 0.0) pendingLookSinceMs = previousPollMs;
+}
+
+static void pollInput() {
+    glfwPollEvents();
+    previousPollMs = profiler.nowMs();
+}
 
-    yaw += xoffset;
-    pitch += yoffset;
-    pitch = clamp(pitch, -89.0f, 89.0f);
+// Late latch: apply the mouse motion gathered so far. Returns the earliest time it can have
+// arrived (profiler time, -1 if there was none) for the input latency measurement.
+static double applyMouseLook() {
+    double since = pendingLookSinceMs;
+    if (since < 0.0) return -1.0;
+    yaw += pendingLookX;
+    pitch = clamp(pitch + pendingLookY, -89.0f, 89.0f);
+    pendingLookX = pendingLookY = 0.0f;
+    pendingLookSinceMs = -1.0;
 
     float yawRad = yaw * 3.14159265f / 180.0f;
     float pitchRad = pitch * 3.14159265f / 180.0f;
@@ -215,13 +4934,31 @@ static void mouseCallback(GLFWwindow* window, double xposIn, double yposIn) {
         std::sin(yawRad) * std::cos(pitchRad)
     };
     cameraFront = normalize(front);
+    return since;
 }
 
-static void processInput(GLFWwindow* window, Vec3& cubeRotation, float& cubeRotationSpeed) {
+static void processInput(GLFWwindow* window, Vec3& cubeRotation, float cubeRotationSpeed, bool& useInstancing,
+                         bool& useDepthPrepass, bool& useGpuCulling) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
 
+    // Toggle instanced cube rendering on key press (edge triggered)
+    static bool instancingKeyWasDown = false;
+    bool instancingKeyDown = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (instancingKeyDown && !instancingKeyWasDown) useInstancing = !useInstancing;
+    instancingKeyWasDown = instancingKeyDown;
+
+    static bool prepassKeyWasDown = false;
+    bool prepassKeyDown = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (prepassKeyDown && !prepassKeyWasDown) useDepthPrepass = !useDepthPrepass;
+    prepassKeyWasDown = prepassKeyDown;
+
+    static bool gpuCullingKeyWasDown = false;
+    bool gpuCullingKeyDown = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (gpuCullingKeyDown && !gpuCullingKeyWasDown) useGpuCulling = !useGpuCulling;
+    gpuCullingKeyWasDown = gpuCullingKeyDown;
+
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) cubeRotation.y -= cubeRotationSpeed * deltaTime;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) cubeRotation.y += cubeRotationSpeed * deltaTime;
     if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) cubeRotation.x -= cubeRotationSpeed * deltaTime;
@@ -230,12 +4967,202 @@ static void processInput(GLFWwindow* window, Vec3& cubeRotation, float& cubeRota
     if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) cubeRotation.z += cubeRotationSpeed * deltaTime;
 }
 
-int main() {
+// Camera path keyframe for benchmark runs; yaw/pitch in degrees like the mouse look
+struct CameraKey {
+    float time;
+    Vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// Text format: one "time x y z yaw pitch" key per line, '#' starts a comment
+static bool loadCameraPath(const std::string& path, std::vector<CameraKey>& keys) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.resize(hash);
+        CameraKey key{};
+        if (std::sscanf(line.c_str(), "%f %f %f %f %f %f", &key.time, &key.position.x, &key.position.y,
+                        &key.position.z, &key.yaw, &key.pitch) == 6) {
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.time < b.time; });
+    return !keys.empty();
+}
+
+// Default scripted path: one slow lap around the scene, looking slightly down at its centre
+static std::vector<CameraKey> orbitCameraPath(float radius, float height, float lapSeconds) {
+    const int keyCount = 32;
+    std::vector<CameraKey> keys;
+    for (int i = 0; i <= keyCount; ++i) {
+        float t = static_cast<float>(i) / keyCount;
+        float angle = t * 2.0f * 3.14159265f;
+        Vec3 position{radius * std::sin(angle), height, radius * std::cos(angle)};
+        float yaw = -90.0f - angle * 180.0f / 3.14159265f;  // Faces the origin from `position`
+        float pitch = -std::atan2(height, radius) * 180.0f / 3.14159265f;
+        keys.push_back({t * lapSeconds, position, yaw, pitch});
+    }
+    return keys;
+}
+
+// Linear interpolation between keys; the path loops after the last key
+static void sampleCameraPath(const std::vector<CameraKey>& keys, float time, Vec3& position, Vec3& front) {
+    float span = keys.back().time - keys.front().time;
+    if (span > 0.0f) time = keys.front().time + std::fmod(time, span);
+    size_t next = 0;
+    while (next < keys.size() && keys[next].time < time) ++next;
+    const CameraKey& b = keys[std::min(next, keys.size() - 1)];
+    const CameraKey& a = keys[next > 0 ? next - 1 : 0];
+    float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    position = add(a.position, mul(sub(b.position, a.position), t));
+    float yawRad = (a.yaw + (b.yaw - a.yaw) * t) * 3.14159265f / 180.0f;
+    float pitchRad = (a.pitch + (b.pitch - a.pitch) * t) * 3.14159265f / 180.0f;
+    front = normalize({std::cos(yawRad) * std::cos(pitchRad), std::sin(pitchRad), std::sin(yawRad) * std::cos(pitchRad)});
+}
+
+// Swap interval: Adaptive (-1) tears instead of waiting when a frame misses vblank
+enum class VsyncMode { Off, On, Adaptive };
+
+// Command-line options
+struct Options {
+    std::string profileCsvPath;  // --profile-csv <file>: per-frame CPU/GPU timings
+    std::string tracePath;       // --trace <file>: Chrome trace-event JSON
+    bool benchmark = false;      // --benchmark: scripted camera, fixed timestep, fixed frame count
+    int benchmarkCubes = 10000;  // --cubes <n>: props in the benchmark scene
+    int benchmarkFrames = 1000;  // --frames <n>: measured frames
+    int warmupFrames = 60;       // --warmup <n>: frames rendered before measuring
+    std::string cameraPath;      // --camera-path <file>: keyframes instead of the default orbit
+    bool hidden = false;         // --hidden: don't show the window
+    bool depthPrepass = true;    // --no-prepass: shade in submission order with GL_LESS
+    std::string bakeInput;       // --bake-texture <in.ppm> <out.dds>: offline BC1 + mips, then exit
+    std::string bakeOutput;
+    std::string scenePath;       // --scene <file>: load a binary scene file instead of the built-in level
+    std::string exportScenePath; // --export-scene <file>: write the level as it was built to a scene file
+    bool exportShaders = false;  // --export-shaders: write the built-in shaders to shaders/ for editing
+    ShaderQuality quality = ShaderQuality::High;  // --quality low|medium|high: main shader variants
+    int lightCount = 256;        // --lights <n>: point lights placed around the props
+    bool gpuCulling = false;     // --gpu-cull: cull and LOD props in a compute shader (GL 4.3)
+    bool spinProps = false;      // --spin-props: benchmark props rotate every frame (every shadow cascade re-renders each frame)
+    float targetGpuMs = -1.0f;   // --target-ms <ms>: GPU time dynamic resolution aims for (0 = native; default 15, off in benchmarks)
+    VsyncMode vsync = VsyncMode::On;  // --vsync off|on|adaptive (benchmarks always run with it off)
+    int maxQueuedFrames = -2;    // --max-queued <0-3|off>: unfinished frames the CPU may run ahead of (default 1, off in benchmarks)
+};
+
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 < argc) return argv[++i];
+            std::cerr << "Missing value for " << arg << std::endl;
+            return {};
+        };
+        if (arg == "--profile-csv") {
+            options.profileCsvPath = value();
+        } else if (arg == "--trace") {
+            options.tracePath = value();
+        } else if (arg == "--benchmark") {
+            options.benchmark = true;
+        } else if (arg == "--cubes") {
+            options.benchmarkCubes = std::max(0, std::atoi(value().c_str()));
+        } else if (arg == "--frames") {
+            options.benchmarkFrames = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "--warmup") {
+            options.warmupFrames = std::max(0, std::atoi(value().c_str()));
+        } else if (arg == "--camera-path") {
+            options.cameraPath = value();
+        } else if (arg == "--hidden") {
+            options.hidden = true;
+        } else if (arg == "--no-prepass") {
+            options.depthPrepass = false;
+        } else if (arg == "--target-ms") {
+            options.targetGpuMs = std::max(0.0f, static_cast<float>(std::atof(value().c_str())));
+        } else if (arg == "--spin-props") {
+            options.spinProps = true;
+        } else if (arg == "--gpu-cull") {
+            options.gpuCulling = true;
+        } else if (arg == "--vsync") {
+            std::string mode = value();
+            if (mode == "off") {
+                options.vsync = VsyncMode::Off;
+            } else if (mode == "on") {
+                options.vsync = VsyncMode::On;
+            } else if (mode == "adaptive") {
+                options.vsync = VsyncMode::Adaptive;
+            } else {
+                std::cerr << "Unknown vsync mode " << mode << ", expected off, on or adaptive" << std::endl;
+            }
+        } else if (arg == "--max-queued") {
+            std::string count = value();
+            options.maxQueuedFrames = count == "off" ? -1 : std::clamp(std::atoi(count.c_str()), 0, FramePacer::maxLimit);
+        } else if (arg == "--export-shaders") {
+            options.exportShaders = true;
+        } else if (arg == "--lights") {
+            options.lightCount = std::max(0, std::atoi(value().c_str()));
+        } else if (arg == "--quality") {
+            std::string tier = value();
+            if (tier == "low") {
+                options.quality = ShaderQuality::Low;
+            } else if (tier == "medium") {
+                options.quality = ShaderQuality::Medium;
+            } else if (tier == "high") {
+                options.quality = ShaderQuality::High;
+            } else {
+                std::cerr << "Unknown quality " << tier << ", expected low, medium or high" << std::endl;
+            }
+        } else if (arg == "--scene") {
+            options.scenePath = value();
+        } else if (arg == "--export-scene") {
+            options.exportScenePath = value();
+        } else if (arg == "--bake-texture") {
+            options.bakeInput = value();
+            options.bakeOutput = value();
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+        }
+    }
+    return options;
+}
+
+// Offline texture bake: PPM in, BC1 DDS with a full mip chain out (no GL context needed)
+static int bakeTexture(const std::string& input, const std::string& output) {
+    std::ifstream in(input, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    int width = 0, height = 0;
+    size_t offset = parsePpmHeader(file, width, height);
+    if (offset == 0) {
+        std::cerr << "Could not read " << input << " (expected a binary 8-bit PPM)" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4, 255);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) std::memcpy(&rgba[i * 4], &file[offset + i * 3], 3);
+    std::vector<uint8_t> blocks;
+    CompressedImage image = bakeBc1MipChain(std::move(rgba), width, height, blocks);
+    if (!writeDds(output, image, blocks)) {
+        std::cerr << "Could not write " << output << std::endl;
+        return 1;
+    }
+    std::cout << output << ": " << width << "x" << height << " BC1, " << image.levels.size() << " mip levels, "
+              << blocks.size() << " bytes" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    if (!options.bakeInput.empty()) return bakeTexture(options.bakeInput, options.bakeOutput);
+
     if (!glfwInit()) return -1;
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_DEPTH_BITS, 0);  // The scene has its own depth in SceneTarget
+    glfwWindowHint(GLFW_STENCIL_BITS, 0);
+    if (options.hidden) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(1600, 900, "3D Overworld", nullptr, nullptr);
     if (!window) {
@@ -244,8 +5171,23 @@ int main() {
     }
 
     glfwMakeContextCurrent(window);
-    glfwSetCursorPosCallback(window, mouseCallback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (options.benchmark) {
+        glfwSwapInterval(0);  // Measure render cost, not the display refresh
+    } else {
+        int interval = options.vsync == VsyncMode::Off ? 0 : 1;
+        if (options.vsync == VsyncMode::Adaptive) {
+            if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+                interval = -1;
+            } else {
+                std::cerr << "Adaptive vsync is not supported, using vsync on" << std::endl;
+            }
+        }
+        glfwSwapInterval(interval);
+        glfwSetCursorPosCallback(window, mouseCallback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // Unaccelerated, unscaled motion straight from the device, where the platform has it
+        if (glfwRawMouseMotionSupported()) glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+    }
 
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK) {
@@ -257,6 +5199,11 @@ int main() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+    // Worker pool for startup and per-frame CPU work; the main thread participates while waiting
+    JobSystem jobs;
+    unsigned hardwareThreads = std::thread::hardware_concurrency();
+    jobs.start(hardwareThreads > 1 ? hardwareThreads - 1 : 0);
+
     float vertices[] = {
         // positions          // normals           // texcoords
         -0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f, 0.0f,
@@ -302,63 +5249,119 @@ int main() {
         -0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   0.0f, 1.0f
     };
 
-    GLuint VAO = 0, VBO = 0;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // Level content comes from a mapped binary scene file with --scene, else from the
+    // built-in arrays. Mapped sections go straight to glBufferData and Scene::append.
+    const uint16_t cubeMeshId = 0;
+    MeshLibrary meshLibrary;
+    MappedFile sceneFile;
+    SceneFileView sceneView;
+    bool sceneFromFile = false;
+    double sceneLoadStart = nowSeconds();
+    if (!options.scenePath.empty()) {
+        if (sceneFile.open(options.scenePath) && parseSceneFile(sceneFile.data, sceneFile.size, sceneView)) {
+            // Every mesh in the file needs all its LODs, and every object a mesh in the file
+            std::vector<uint32_t> lodsFound;
+            for (size_t i = 0; i < sceneView.meshLodCount; ++i) {
+                const SceneMeshLod& lod = sceneView.meshLods[i];
+                if (lod.level >= static_cast<uint32_t>(MeshLibrary::lodCount) || lod.meshId > 0xFFFFu) continue;
+                if (lod.meshId >= meshLibrary.meshes.size()) {
+                    meshLibrary.meshes.resize(lod.meshId + 1u);
+                    lodsFound.resize(lod.meshId + 1u);
+                }
+                meshLibrary.meshes[lod.meshId][lod.level] = lod.range;
+                lodsFound[lod.meshId] |= 1u << lod.level;
+            }
+            const uint32_t allLods = (1u << MeshLibrary::lodCount) - 1u;
+            sceneFromFile = !lodsFound.empty() &&
+                            std::all_of(lodsFound.begin(), lodsFound.end(), [&](uint32_t found) { return found == allLods; }) &&
+                            std::all_of(sceneView.meshId, sceneView.meshId + sceneView.objectCount,
+                                        [&](uint16_t mesh) { return mesh < lodsFound.size(); });
+        }
+        if (!sceneFromFile) {
+            meshLibrary.meshes.clear();
+            std::cerr << "Could not load scene " << options.scenePath << ", using the built-in level" << std::endl;
+            sceneFile.close();
+        }
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // Indexed cube: 24 unique vertices + 36 indices, packed to 16 bytes per vertex. Twelve
+    // triangles is already the least a cube can be, so both of its LODs are the same range;
+    // scene files can still carry real far meshes.
+    std::vector<PackedVertex> cubeVertices;
+    std::vector<GLushort> cubeIndices;
+    if (sceneFromFile) {
+        meshLibrary.upload(sceneView.vertices, sceneView.vertexCount, sceneView.indices, sceneView.indexCount);
+        if (!options.exportScenePath.empty()) {
+            cubeVertices.assign(sceneView.vertices, sceneView.vertices + sceneView.vertexCount);
+            cubeIndices.assign(sceneView.indices, sceneView.indices + sceneView.indexCount);
+        }
+    } else {
+        MeshData cubeMesh = buildIndexedMesh(vertices, sizeof(vertices) / (8 * sizeof(float)), 8);
+        MeshLod detail{static_cast<GLsizei>(cubeMesh.indices.size()), 0, 0};
+        meshLibrary.meshes.push_back({detail, detail});  // cubeMeshId
+        cubeVertices = packMeshVertices(cubeMesh);
+        cubeIndices = cubeMesh.indices;
+        meshLibrary.upload(cubeVertices.data(), cubeVertices.size(), cubeIndices.data(), cubeIndices.size());
+    }
 
-    float groundVertices[] = {
-        // positions            // normals        // texcoords
-        -1.0f, 0.0f, -1.0f,      0.0f, 1.0f, 0.0f,  0.0f, 0.0f,
-         1.0f, 0.0f, -1.0f,      0.0f, 1.0f, 0.0f,  8.0f, 0.0f,
-         1.0f, 0.0f,  1.0f,      0.0f, 1.0f, 0.0f,  8.0f, 8.0f,
+    // Per-frame GPU data (instance attributes, indirect commands, per-frame uniform blocks) is
+    // sub-allocated from a fenced ring; resized to the scene once it is built
+    StreamRing streamRing;
+    streamRing.init(1 << 20);
 
-        -1.0f, 0.0f, -1.0f,      0.0f, 1.0f, 0.0f,  0.0f, 0.0f,
-         1.0f, 0.0f,  1.0f,      0.0f, 1.0f, 0.0f,  8.0f, 8.0f,
-        -1.0f, 0.0f,  1.0f,      0.0f, 1.0f, 0.0f,  0.0f, 8.0f
-    };
+    // Instance attributes: model matrices (4 vec4 columns) and tints, advanced once per instance.
+    // Matrices are a separate range so composeTransforms writes them in place.
+    glBindBuffer(GL_ARRAY_BUFFER, streamRing.buffer);
+    for (int col = 0; col < 4; ++col) {
+        glVertexAttribPointer(3 + col, 4, GL_FLOAT, GL_FALSE, sizeof(Mat4), (void*)(col * 4 * sizeof(float)));
+        glEnableVertexAttribArray(3 + col);
+        glVertexAttribDivisor(3 + col, 1);
+    }
+    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3), (void*)0);
+    glEnableVertexAttribArray(7);
+    glVertexAttribDivisor(7, 1);
 
-    GLuint groundVAO = 0, groundVBO = 0;
-    glGenVertexArrays(1, &groundVAO);
-    glGenBuffers(1, &groundVBO);
-    glBindVertexArray(groundVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, groundVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(groundVertices), groundVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // Streamed heightfield terrain replaces the old fixed ground quad
+    Terrain terrain;
+    terrain.init();
 
     std::string vertexShader = R"(
         #version 330 core
         layout (location = 0) in vec3 aPos;
         layout (location = 1) in vec3 aNormal;
         layout (location = 2) in vec2 aTex;
+        layout (location = 3) in mat4 aInstanceModel;  // Occupies locations 3..6
+        layout (location = 7) in vec3 aInstanceTint;
+        layout (location = 8) in vec2 aMorph;  // Terrain: x = coarser level's height, y = level that drops this vertex
+
+        layout (std140) uniform FrameData {
+            mat4 uView;
+            mat4 uProjection;
+            vec4 uViewPos;
+            vec4 uLightDir;
+        };
 
         uniform mat4 uModel;
-        uniform mat4 uView;
-        uniform mat4 uProjection;
+        uniform vec3 uColorTint;
+        uniform bool uInstanced;
+        uniform vec3 uLod;  // x = terrain level being drawn (-1 = no morphing), y/z = morph start/end distance
 
         out vec3 FragPos;
         out vec3 Normal;
         out vec2 TexCoord;
+        out vec3 ColorTint;
+        invariant gl_Position;  // The depth prepass links this same shader; GL_EQUAL needs bit-identical depth
 
         void main() {
-            FragPos = vec3(uModel * vec4(aPos, 1.0));
-            Normal = mat3(transpose(inverse(uModel))) * aNormal;
+            mat4 model = uInstanced ? aInstanceModel : uModel;
+            FragPos = vec3(model * vec4(aPos, 1.0));
+            if (aMorph.y == uLod.x) {
+                float morph = clamp((distance(FragPos, uViewPos.xyz) - uLod.y) / (uLod.z - uLod.y), 0.0, 1.0);
+                FragPos.y = mix(FragPos.y, aMorph.x, morph);
+            }
+            Normal = mat3(transpose(inverse(model))) * aNormal;
             TexCoord = aTex;
+            ColorTint = uInstanced ? aInstanceTint : uColorTint;
             gl_Position = uProjection * uView * vec4(FragPos, 1.0);
         }
     )";
@@ -370,15 +5373,25 @@ int main() {
         in vec3 FragPos;
         in vec3 Normal;
         in vec2 TexCoord;
+        in vec3 ColorTint;
+
+        layout (std140) uniform FrameData {
+            mat4 uView;
+            mat4 uProjection;
+            vec4 uViewPos;   // xyz = camera position
+            vec4 uLightDir;  // xyz = sun light direction
+        };
 
-        uniform vec3 uLightDir;
-        uniform vec3 uViewPos;
         uniform sampler2D uTexture;
-        uniform samplerCube uEnvMap;
-        uniform vec3 uColorTint;
-        uniform vec3 uFogColor;
-        uniform float uFogDensity;
-        uniform mat4 uView;
+        uniform samplerCube uSpecularEnv;  // Prefiltered sky: mip k = Phong lobe of exponent 4^(6 - k)
+        uniform vec3 uIrradianceSH[9];     // Sky irradiance / pi, SH basis constants folded in
+        uniform sampler2DArrayShadow uShadowMap;  // One depth layer per sun cascade
+
+        layout (std140) uniform ShadowData {
+            mat4 uShadowMatrix[3];  // World -> cascade texture space
+            vec4 uShadowSplits;     // Camera distance covered by each cascade
+            vec4 uShadowTexel;      // World size of one shadow texel per cascade
+        };
 
         // Cinematic lighting parameters
         const vec3 sunColor = vec3(1.0, 0.95, 0.85);       // Warm sunlight
@@ -388,72 +5401,183 @@ int main() {
         const float ambientIntensity = 0.25;
         const float rimPower = 3.0;
         const float rimIntensity = 0.5;
+        const float envSpecularLod = 4.0;  // Exponent 16: the Phong lobe matching Blinn-Phong shininess 64
+        const float envSpecularIntensity = 0.35;
+
+        // Cosine-weighted average sky radiance around a world-space normal
+        vec3 skyIrradiance(vec3 n) {
+            return uIrradianceSH[0] + uIrradianceSH[1] * n.y + uIrradianceSH[2] * n.z + uIrradianceSH[3] * n.x
+                 + uIrradianceSH[4] * (n.x * n.y) + uIrradianceSH[5] * (n.y * n.z)
+                 + uIrradianceSH[6] * (3.0 * n.z * n.z - 1.0) + uIrradianceSH[7] * (n.x * n.z)
+                 + uIrradianceSH[8] * (n.x * n.x - n.y * n.y);
+        }
+
+        #ifdef FEATURE_POINT_LIGHTS
+        uniform usamplerBuffer uClusterGrid;   // Per cluster: first index, light count
+        uniform usamplerBuffer uLightIndices;  // Cluster light lists
+        uniform samplerBuffer uLightData;      // Per light: (position, radius), (color * intensity, 0)
+
+        layout (std140) uniform LightGrid {
+            vec4 uClusterScale;  // xy = pixels per tile, z/w: slice = log(view depth) * z + w
+            ivec4 uClusterDims;  // Tiles x, tiles y, depth slices, light count
+        };
+
+        // Point lights of this fragment's cluster: Lambert + Blinn-Phong with a smooth
+        // inverse-square falloff that reaches zero at the light's radius
+        vec3 pointLighting(vec3 worldPos, vec3 n, vec3 viewDir, vec3 albedo, float specularFactor) {
+            float depth = max(-(uView * vec4(worldPos, 1.0)).z, 1e-4);
+            ivec3 c = ivec3(ivec2(gl_FragCoord.xy / uClusterScale.xy), int(floor(log(depth) * uClusterScale.z + uClusterScale.w)));
+            c = clamp(c, ivec3(0), uClusterDims.xyz - 1);
+            uvec2 range = texelFetch(uClusterGrid, (c.z * uClusterDims.y + c.y) * uClusterDims.x + c.x).xy;
+            vec3 sum = vec3(0.0);
+            for (uint i = 0u; i < range.y; ++i) {
+                int light = int(texelFetch(uLightIndices, int(range.x + i)).r);
+                vec4 positionRadius = texelFetch(uLightData, light * 2);
+                vec3 toLight = positionRadius.xyz - worldPos;
+                float d2 = dot(toLight, toLight);
+                float ratio2 = d2 / (positionRadius.w * positionRadius.w);
+                if (ratio2 >= 1.0) continue;
+                float window = 1.0 - ratio2 * ratio2;
+                float attenuation = window * window / (d2 + 1.0);
+                vec3 l = toLight * inversesqrt(max(d2, 1e-6));
+                float diff = max(dot(n, l), 0.0);
+                float spec = pow(max(dot(n, normalize(l + viewDir)), 0.0), 64.0) * specularFactor * step(0.0, diff);
+                sum += (albedo * diff + spec) * texelFetch(uLightData, light * 2 + 1).rgb * attenuation;
+            }
+            return sum;
+        }
+        #endif
+
+        #ifdef FEATURE_SHADOWS
+        // Fraction of sunlight reaching a point: the nearest cascade covering it, offset along
+        // the normal against acne, four bilinear PCF taps, faded out past the last split
+        float sunVisibility(vec3 worldPos, vec3 n, float dist) {
+            int cascade = dist < uShadowSplits.x ? 0 : (dist < uShadowSplits.y ? 1 : 2);
+            if (dist >= uShadowSplits.z) return 1.0;
+            vec4 p = uShadowMatrix[cascade] * vec4(worldPos + n * (1.5 * uShadowTexel[cascade]), 1.0);
+            vec2 texel = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+            float lit = 0.0;
+            lit += texture(uShadowMap, vec4(p.xy + vec2(-0.5, -0.5) * texel, float(cascade), p.z));
+            lit += texture(uShadowMap, vec4(p.xy + vec2( 0.5, -0.5) * texel, float(cascade), p.z));
+            lit += texture(uShadowMap, vec4(p.xy + vec2(-0.5,  0.5) * texel, float(cascade), p.z));
+            lit += texture(uShadowMap, vec4(p.xy + vec2( 0.5,  0.5) * texel, float(cascade), p.z));
+            float fade = clamp((dist - 0.9 * uShadowSplits.z) / (0.1 * uShadowSplits.z), 0.0, 1.0);
+            return mix(lit * 0.25, 1.0, fade);
+        }
+        #endif
 
         void main() {
             vec3 norm = normalize(Normal);
-            vec3 lightDir = normalize(-uLightDir);
-            vec3 viewDir = normalize(uViewPos - FragPos);
+            vec3 lightDir = normalize(-uLightDir.xyz);
+            vec3 viewDir = normalize(uViewPos.xyz - FragPos);
+            float distanceToCamera = length(uViewPos.xyz - FragPos);
             
             // Blinn-Phong halfway vector for better specular
             vec3 halfwayDir = normalize(lightDir + viewDir);
             
-            // Hemisphere ambient lighting (sky above, ground below)
+            // Hemisphere ambient lighting (sky above, ground below); the cubemap is world space
             float hemisphereBlend = norm.y * 0.5 + 0.5;
-            vec3 envDir = normalize(mat3(uView) * norm);
-            vec3 skyAmbient = texture(uEnvMap, envDir).rgb;
+            vec3 skyAmbient = max(skyIrradiance(norm), vec3(0.0));
             vec3 ambient = mix(groundColor, skyAmbient, hemisphereBlend) * ambientIntensity;
+
+        #ifdef FEATURE_SHADOWS
+            float shadow = sunVisibility(FragPos, norm, distanceToCamera);
+        #else
+            float shadow = 1.0;
+        #endif
             
-            // Wrapped diffuse for softer shadows
             float NdotL = dot(norm, lightDir);
-            float wrappedDiff = max((NdotL + 0.3) / 1.3, 0.0);
-            vec3 diffuse = wrappedDiff * sunColor * sunIntensity;
+        #ifdef FEATURE_WRAPPED_DIFFUSE
+            // Wrapped diffuse for softer shadows
+            float diff = max((NdotL + 0.3) / 1.3, 0.0);
+        #else
+            float diff = max(NdotL, 0.0);
+        #endif
+            vec3 diffuse = diff * sunColor * sunIntensity * shadow;
             
             // Blinn-Phong specular with roughness
             float NdotH = max(dot(norm, halfwayDir), 0.0);
             float shininess = 64.0;
             float spec = pow(NdotH, shininess);
             
+            float F0 = 0.04;  // Base reflectivity for dielectrics
+        #ifdef FEATURE_FRESNEL
             // Fresnel-Schlick approximation for realistic specular falloff
             float fresnel = pow(1.0 - max(dot(viewDir, halfwayDir), 0.0), 5.0);
-            float F0 = 0.04;  // Base reflectivity for dielectrics
             float fresnelFactor = F0 + (1.0 - F0) * fresnel;
+        #else
+            float fresnelFactor = F0;
+        #endif
             
             // Apply specular only on lit surfaces
             float specMask = smoothstep(0.0, 0.1, NdotL);
-            vec3 specular = spec * fresnelFactor * sunColor * specMask * 0.8;
-            
-            // Rim lighting (backlight effect)
-            float rimDot = 1.0 - max(dot(viewDir, norm), 0.0);
-            float rimAmount = pow(rimDot, rimPower);
-            // Enhance rim on surfaces facing away from light (silhouette effect)
-            float rimShadow = 1.0 - max(NdotL, 0.0);
-            vec3 rim = rimAmount * rimShadow * rimColor * rimIntensity;
+            vec3 specular = spec * fresnelFactor * sunColor * specMask * 0.8 * shadow;
+
+        #ifdef FEATURE_ENV_SPECULAR
+            // Sky reflection from the prefiltered mip of matching glossiness
+            vec3 reflected = reflect(-viewDir, norm);
+            specular += textureLod(uSpecularEnv, reflected, envSpecularLod).rgb * fresnelFactor * envSpecularIntensity;
+        #endif
             
             // Sample albedo texture
-            vec3 albedo = texture(uTexture, TexCoord).rgb * uColorTint;
+            vec3 albedo = texture(uTexture, TexCoord).rgb * ColorTint;
             
             // Energy conservation: reduce diffuse where specular is strong
             vec3 diffuseContrib = diffuse * (1.0 - fresnelFactor * 0.5);
             
             // Combine lighting
-            vec3 lit = (ambient + diffuseContrib) * albedo + specular + rim * albedo;
-            
-            // Subtle tone mapping for HDR-like feel
-            lit = lit / (lit + vec3(1.0));
-            
-            // Atmospheric fog with distance
-            float distanceToCamera = length(uViewPos - FragPos);
-            float fogFactor = clamp(exp(-pow(distanceToCamera * uFogDensity, 1.5)), 0.0, 1.0);
-            vec3 fogged = mix(uFogColor, lit, fogFactor);
+            vec3 lit = (ambient + diffuseContrib) * albedo + specular;
+
+        #ifdef FEATURE_RIM
+            // Rim lighting (backlight effect)
+            float rimDot = 1.0 - max(dot(viewDir, norm), 0.0);
+            float rimAmount = pow(rimDot, rimPower);
+            // Enhance rim on surfaces facing away from light (silhouette effect)
+            float rimShadow = 1.0 - max(NdotL, 0.0);
+            lit += rimAmount * rimShadow * rimColor * rimIntensity * albedo;
+        #endif
+
+        #ifdef FEATURE_POINT_LIGHTS
+            lit += pointLighting(FragPos, norm, viewDir, albedo, fresnelFactor);
+        #endif
             
-            // Final gamma correction hint (slight contrast boost)
-            fogged = pow(fogged, vec3(0.95));
+        #ifdef FEATURE_FOG
+            // Atmospheric fog with distance; color and density are per-level constants
+            float fogFactor = clamp(exp(-pow(distanceToCamera * FOG_DENSITY, 1.5)), 0.0, 1.0);
+            lit = mix(FOG_COLOR, lit, fogFactor);
+        #endif
 
-            FragColor = vec4(fogged, 1.0);
+            // Linear HDR; the present pass tonemaps and gamma-corrects once per screen pixel
+            FragColor = vec4(lit, 1.0);
         }
     )";
 
-    GLuint program = createProgram(vertexShader, fragmentShader);
+    // Linked programs come from the binary cache on warm starts; shaders/ files override
+    // the inline sources and are hot-reloaded
+    ShaderLibrary shaders;
+    double shaderStart = nowSeconds();
+
+    // One main-shader variant per material at the chosen quality: the cheapest that still has
+    // every term the material uses. Fog is constant per level, so it is compiled in too.
+    const float fogDensity = 0.03f;
+    const Vec3 fogColor{0.11f, 0.21f, 0.63f};  // Scene-linear: about (0.35, 0.45, 0.65) on screen
+    const std::string levelDefines = "#define FOG_COLOR vec3(" + std::to_string(fogColor.x) + ", " +
+                                     std::to_string(fogColor.y) + ", " + std::to_string(fogColor.z) +
+                                     ")\n#define FOG_DENSITY " + std::to_string(fogDensity) + "\n";
+    const ShaderProgram* materialPrograms[static_cast<int>(Material::Count)];
+    for (int m = 0; m < static_cast<int>(Material::Count); ++m) {
+        uint32_t features = programFeatures(static_cast<Material>(m), options.quality);
+        materialPrograms[m] = &shaders.load("main.vert", vertexShader, "main.frag", fragmentShader,
+                                            featureDefines(features) + levelDefines);
+    }
+
+    // Depth prepass: the main vertex shader with an empty fragment shader, so the shading
+    // pass can run with GL_EQUAL and shade each visible pixel once
+    const std::string depthFragmentShader = R"(
+        #version 330 core
+        void main() {}
+    )";
+    ShaderProgram& depthProgram = shaders.load("main.vert", vertexShader, "depth.frag", depthFragmentShader);
 
     // Skybox shader
     std::string skyboxVS = R"(
@@ -462,8 +5586,12 @@ int main() {
         
         out vec3 TexCoords;
         
-        uniform mat4 uProjection;
-        uniform mat4 uView;
+        layout (std140) uniform FrameData {
+            mat4 uView;
+            mat4 uProjection;
+            vec4 uViewPos;
+            vec4 uLightDir;
+        };
         
         void main() {
             TexCoords = aPos;
@@ -483,16 +5611,71 @@ int main() {
         uniform samplerCube uSkybox;
         
         void main() {
-            vec3 color = texture(uSkybox, TexCoords).rgb;
-            // HDR tone mapping
+            // The horizon band is fully fogged (the elevation props past the fog cut-off can reach),
+            // so they and the terrain edge fade into the sky instead of popping against it
+            float horizon = 1.0 - smoothstep(0.1, 0.3, normalize(TexCoords).y);
+            vec3 sky = mix(texture(uSkybox, TexCoords).rgb, FOG_COLOR, horizon);
+            FragColor = vec4(sky, 1.0);  // Linear HDR, tonemapped at present
+        }
+    )";
+
+    ShaderProgram& skyboxProgram = shaders.load("sky.vert", skyboxVS, "sky.frag", skyboxFS, levelDefines);
+
+    // Present: one full-screen triangle that upscales the rendered corner of the scene target
+    // (bilinear), then tonemaps and gamma-corrects, once per window pixel
+    std::string presentVS = R"(
+        #version 330 core
+        uniform vec2 uUvScale;  // Rendered fraction of the scene target
+        out vec2 TexCoord;
+
+        void main() {
+            vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+            TexCoord = corner * uUvScale;
+            gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )";
+
+    std::string presentFS = R"(
+        #version 330 core
+        out vec4 FragColor;
+        in vec2 TexCoord;
+
+        uniform sampler2D uScene;
+        uniform vec2 uUvMax;  // Last rendered texel centre: keeps the filter off unrendered texels
+
+        void main() {
+            vec3 color = texture(uScene, min(TexCoord, uUvMax)).rgb;
             color = color / (color + vec3(1.0));
-            // Gamma correction
-            color = pow(color, vec3(1.0/2.2));
-            FragColor = vec4(color, 1.0);
+            // Exact sRGB encode, the inverse of the albedo textures' decode
+            vec3 encoded = mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+            FragColor = vec4(encoded, 1.0);
         }
     )";
 
-    GLuint skyboxProgram = createProgram(skyboxVS, skyboxFS);
+    ShaderProgram& presentProgram = shaders.load("present.vert", presentVS, "present.frag", presentFS);
+    std::cout << "shaders: " << shaders.entries.size() << " programs (" << shaders.fromBinary
+              << " from the binary cache) in " << (nowSeconds() - shaderStart) * 1000.0 << " ms" << std::endl;
+    if (options.exportShaders) shaders.exportSources();
+
+    // Sun shadows: the cascade pass swaps in its own FrameData (light view/projection) while
+    // it renders; ShadowData carries the cascade matrices to the shading pass and only
+    // changes when a cascade is re-fitted, so it keeps a buffer of its own
+    const Vec3 sunDirection{-0.25f, -1.0f, -0.35f};  // Direction the sun light travels
+    ShadowCascades shadows;
+    shadows.init();
+    const uint32_t usedFeatures = programFeatures(Material::Terrain, options.quality) |
+                                  programFeatures(Material::Prop, options.quality);
+    const bool sunShadows = usedFeatures & FeatureShadows;
+    GLuint shadowDataUBO = 0;
+    glGenBuffers(1, &shadowDataUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, shadowDataUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowCascades::Uniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, shadowDataBinding, shadowDataUBO);
+
+    // Clustered point lights: binned on the CPU each frame, read through texture buffers
+    const bool pointLights = usedFeatures & FeaturePointLights;
+    ClusteredLights clusteredLights;
+    clusteredLights.init();
 
     // Skybox cube vertices (inside-out cube)
     float skyboxVertices[] = {
@@ -540,14 +5723,21 @@ int main() {
         -1.0f, -1.0f, -1.0f
     };
 
-    GLuint skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // Indexed skybox: 8 corner vertices + 36 indices
+    MeshData skyboxMesh = buildIndexedMesh(skyboxVertices, sizeof(skyboxVertices) / (3 * sizeof(float)), 3);
+    const GLsizei skyboxIndexCount = static_cast<GLsizei>(skyboxMesh.indices.size());
+    GLuint skyboxVAO = 0, skyboxVBO = 0, skyboxEBO = 0;
+    uploadMesh(skyboxMesh, false, skyboxVAO, skyboxVBO, skyboxEBO);
+    GLuint presentVAO = 0;  // Attribute-less: the present triangle comes from gl_VertexID
+    glGenVertexArrays(1, &presentVAO);
+
+    // Everything up to the present pass renders into the HDR scene target, at a resolution
+    // steered towards the GPU time budget
+    SceneTarget sceneTarget;
+    DynamicResolution dynamicResolution;
+    dynamicResolution.targetMs = options.targetGpuMs >= 0.0f ? options.targetGpuMs : (options.benchmark ? 0.0f : 15.0f);
+    FramePacer framePacer;
+    framePacer.maxQueued = options.maxQueuedFrames >= -1 ? options.maxQueuedFrames : (options.benchmark ? -1 : 1);
 
     // Create procedural HDR cubemap texture
     GLuint skyboxTexture;
@@ -555,84 +5745,28 @@ int main() {
     glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
 
     const int skySize = 256;
-    std::vector<float> skyFaceData(skySize * skySize * 3);
-
-    // Sun direction (normalized)
-    float sunDirX = 0.4f, sunDirY = 0.6f, sunDirZ = -0.7f;
-    float sunLen = std::sqrt(sunDirX*sunDirX + sunDirY*sunDirY + sunDirZ*sunDirZ);
-    sunDirX /= sunLen; sunDirY /= sunLen; sunDirZ /= sunLen;
+    SkyParams skyParams;
+    std::vector<GLuint> skyData;
+    std::string skyCachePath = skyCacheFile(skyParams, skySize, "rgb9e5");
+    if (!loadSkyCache(skyCachePath, skyParams, skySize, static_cast<size_t>(6) * skySize * skySize, skyData)) {
+        skyData.resize(static_cast<size_t>(6) * skySize * skySize);
+        // One job per block of rows across all six faces; each thread reuses its own scratch row
+        std::vector<float> skyScratch(jobs.threadCount() * skySize * 3);
+        jobs.parallelFor(static_cast<size_t>(6) * skySize, 16, [&](size_t begin, size_t end) {
+            float* rgb = &skyScratch[static_cast<size_t>(JobSystem::threadIndex()) * skySize * 3];
+            for (size_t row = begin; row < end; ++row) {
+                int face = static_cast<int>(row / skySize);
+                int y = static_cast<int>(row % skySize);
+                generateSkyRow(skyParams, skySize, face, y, rgb, &skyData[row * skySize]);
+            }
+        });
+        saveSkyCache(skyCachePath, skyParams, skySize, skyData);
+    }
 
-    // Generate each cubemap face
+    const size_t skyFaceTexels = static_cast<size_t>(skySize) * skySize;
     for (int face = 0; face < 6; ++face) {
-        for (int y = 0; y < skySize; ++y) {
-            for (int x = 0; x < skySize; ++x) {
-                // Convert pixel to direction vector for this face
-                float u = (x + 0.5f) / skySize * 2.0f - 1.0f;
-                float v = (y + 0.5f) / skySize * 2.0f - 1.0f;
-                float dx, dy, dz;
-                
-                switch (face) {
-                    case 0: dx =  1.0f; dy = -v;    dz = -u;    break; // +X
-                    case 1: dx = -1.0f; dy = -v;    dz =  u;    break; // -X
-                    case 2: dx =  u;    dy =  1.0f; dz =  v;    break; // +Y
-                    case 3: dx =  u;    dy = -1.0f; dz = -v;    break; // -Y
-                    case 4: dx =  u;    dy = -v;    dz =  1.0f; break; // +Z
-                    case 5: dx = -u;    dy = -v;    dz = -1.0f; break; // -Z
-                }
-                
-                // Normalize direction
-                float len = std::sqrt(dx*dx + dy*dy + dz*dz);
-                dx /= len; dy /= len; dz /= len;
-                
-                // Calculate sky gradient based on elevation
-                float elevation = dy;  // -1 (down) to 1 (up)
-                
-                // HDR sky colors (values > 1 for HDR)
-                float r, g, b;
-                
-                if (elevation > 0.0f) {
-                    // Sky gradient: horizon to zenith
-                    float t = std::pow(elevation, 0.5f);
-                    // Horizon: warm golden (1.8, 1.4, 0.9)
-                    // Zenith: deep blue (0.2, 0.4, 1.2)
-                    r = 1.8f * (1.0f - t) + 0.2f * t;
-                    g = 1.4f * (1.0f - t) + 0.4f * t;
-                    b = 0.9f * (1.0f - t) + 1.2f * t;
-                } else {
-                    // Ground gradient
-                    float t = std::min(1.0f, -elevation * 2.0f);
-                    // Horizon: warm (1.0, 0.8, 0.6)
-                    // Nadir: dark earth (0.15, 0.12, 0.1)
-                    r = 1.0f * (1.0f - t) + 0.15f * t;
-                    g = 0.8f * (1.0f - t) + 0.12f * t;
-                    b = 0.6f * (1.0f - t) + 0.10f * t;
-                }
-                
-                // Add sun glow
-                float sunDot = dx * sunDirX + dy * sunDirY + dz * sunDirZ;
-                if (sunDot > 0.0f) {
-                    // Sun disc (very bright HDR)
-                    float sunDisc = std::pow(std::max(0.0f, sunDot), 256.0f);
-                    r += sunDisc * 30.0f;
-                    g += sunDisc * 28.0f;
-                    b += sunDisc * 20.0f;
-                    
-                    // Sun glow (softer)
-                    float sunGlow = std::pow(std::max(0.0f, sunDot), 8.0f);
-                    r += sunGlow * 1.5f;
-                    g += sunGlow * 1.2f;
-                    b += sunGlow * 0.6f;
-                }
-                
-                int idx = (y * skySize + x) * 3;
-                skyFaceData[idx + 0] = r;
-                skyFaceData[idx + 1] = g;
-                skyFaceData[idx + 2] = b;
-            }
-        }
-        
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F,
-                     skySize, skySize, 0, GL_RGB, GL_FLOAT, skyFaceData.data());
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB9_E5, skySize, skySize, 0, GL_RGB,
+                     GL_UNSIGNED_INT_5_9_9_9_REV, skyData.data() + face * skyFaceTexels);
     }
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -641,6 +5775,82 @@ int main() {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+    // Ambient SH and the prefiltered reflection cubemap, derived from the sky once and cached
+    // next to it ("env1": bump when computeSkyLighting changes)
+    SkyLighting skyLighting;
+    {
+        std::vector<GLuint> cached;
+        std::string envCachePath = skyCacheFile(skyParams, skySize, "env1");
+        if (loadSkyCache(envCachePath, skyParams, skySize, 27 + SkyLighting::specularTexels(), cached)) {
+            skyLighting.deserialize(cached);
+        } else {
+            ProfileScope scope("sky lighting");
+            computeSkyLighting(skyData, skySize, jobs, skyLighting);
+            saveSkyCache(envCachePath, skyParams, skySize, skyLighting.serialize());
+        }
+    }
+    GLuint skyEnvTexture = 0;
+    glGenTextures(1, &skyEnvTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skyEnvTexture);
+    {
+        const GLuint* levelData = skyLighting.specular.data();
+        for (int level = 0; level < SkyLighting::specularLevels; ++level) {
+            int levelSize = SkyLighting::specularSize >> level;
+            for (int face = 0; face < 6; ++face) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB9_E5, levelSize, levelSize, 0, GL_RGB,
+                             GL_UNSIGNED_INT_5_9_9_9_REV, levelData);
+                levelData += static_cast<size_t>(levelSize) * levelSize;
+            }
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, SkyLighting::specularLevels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // Uniform locations and per-program constants; looked up again whenever a program is rebuilt
+    struct DrawProgram {
+        const ShaderProgram* program = nullptr;
+        GLint model = -1, tint = -1, instanced = -1, lod = -1;
+    };
+    DrawProgram materialDraws[static_cast<int>(Material::Count)];
+    DrawProgram depthDraw;
+    GLint presentUvScale = -1, presentUvMax = -1;
+    auto configurePrograms = [&]() {
+        auto locate = [](DrawProgram& draw, const ShaderProgram& shaderProgram) {
+            draw.program = &shaderProgram;
+            draw.model = shaderProgram.uniform("uModel");
+            draw.tint = shaderProgram.uniform("uColorTint");
+            draw.instanced = shaderProgram.uniform("uInstanced");
+            draw.lod = shaderProgram.uniform("uLod");
+            glUseProgram(shaderProgram.id);
+            glUniform3f(draw.lod, -1.0f, 0.0f, 1.0f);
+        };
+        for (int m = 0; m < static_cast<int>(Material::Count); ++m) {
+            const ShaderProgram& shaderProgram = *materialPrograms[m];
+            locate(materialDraws[m], shaderProgram);
+            glUniform1i(shaderProgram.uniform("uTexture"), 0);
+            glUniform1i(shaderProgram.uniform("uSpecularEnv"), 1);
+            glUniform1i(shaderProgram.uniform("uShadowMap"), 2);
+            glUniform1i(shaderProgram.uniform("uClusterGrid"), 3);
+            glUniform1i(shaderProgram.uniform("uLightIndices"), 4);
+            glUniform1i(shaderProgram.uniform("uLightData"), 5);
+            glUniform3fv(shaderProgram.uniform("uIrradianceSH"), 9, &skyLighting.irradianceSH[0].x);
+        }
+        locate(depthDraw, depthProgram);
+
+        glUseProgram(skyboxProgram.id);
+        glUniform1i(skyboxProgram.uniform("uSkybox"), 0);
+
+        glUseProgram(presentProgram.id);
+        glUniform1i(presentProgram.uniform("uScene"), 0);
+        presentUvScale = presentProgram.uniform("uUvScale");
+        presentUvMax = presentProgram.uniform("uUvMax");
+    };
+    configurePrograms();
+
     GLuint texture = 0;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -661,8 +5871,36 @@ int main() {
             texData[idx + 2] = value;
         }
     }
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texSize, texSize, 0, GL_RGB, GL_UNSIGNED_BYTE, texData.data());
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (GLEW_EXT_texture_compression_s3tc) {
+        // BC1 with a CPU-built mip chain: 2 KB + mips instead of 12 KB
+        std::vector<uint8_t> rgba(static_cast<size_t>(texSize) * texSize * 4, 255);
+        for (size_t i = 0; i < static_cast<size_t>(texSize) * texSize; ++i) std::memcpy(&rgba[i * 4], &texData[i * 3], 3);
+        std::vector<uint8_t> blocks;
+        CompressedImage checker = bakeBc1MipChain(std::move(rgba), texSize, texSize, blocks);
+        checker.format = compressedFormatSupported(srgbFormat(checker.format)) ? srgbFormat(checker.format) : checker.format;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(checker.levels.size()) - 1);
+        for (int level = 0; level < static_cast<int>(checker.levels.size()); ++level) {
+            uploadCompressedLevel(checker, level, reinterpret_cast<uintptr_t>(blocks.data()));
+        }
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, texSize, texSize, 0, GL_RGB, GL_UNSIGNED_BYTE, texData.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    // Optional textures streamed from assets/ (first of .dds, .ktx2, .ppm); the checker stands in until they're ready
+    AssetLoader assets;
+    assets.init();
+    const uint32_t noAsset = UINT32_MAX;
+    auto requestIfPresent = [&](const std::string& stem) {
+        for (const char* extension : {".dds", ".ktx2", ".ppm"}) {
+            if (std::filesystem::exists(stem + extension)) return assets.requestTexture(stem + extension, jobs);
+        }
+        return noAsset;
+    };
+    const uint32_t groundTexture = requestIfPresent("assets/ground");
+    const uint32_t propTexture = requestIfPresent("assets/prop");
+    auto textureOrChecker = [&](uint32_t handle) { return handle == noAsset ? texture : assets.texture(handle, texture); };
+    const double assetUploadBudgetMs = 2.0;
 
     std::vector<Vec3> cubePositions = {
         {0.0f, 0.0f, 0.0f},
@@ -684,145 +5922,652 @@ int main() {
         {1.0f, 0.85f, 0.7f}
     };
 
-    Vec3 groundScale{40.0f, 1.0f, 40.0f};
     Vec3 groundTint{0.65f, 0.85f, 0.65f};
 
-    Vec3 cubeRotation{0.0f, 0.0f, 0.0f};
+    // Scene objects: one cube per level position, each offset around Y by its index
+    const float cubeCullExtent = 0.8661f;  // Half-diagonal of a unit cube: encloses it under any rotation
+    const float cubeCollisionExtent = 0.6f;
+    Scene scene;
+    if (sceneFromFile) {
+        const SceneFileView& v = sceneView;
+        scene.append(v.objectCount, v.position, v.rotation, v.scale, v.tint, v.bounds, v.collider, v.meshId);
+        std::cout << options.scenePath << ": " << v.objectCount << " objects, " << sceneFile.size / 1024
+                  << " KB loaded in " << (nowSeconds() - sceneLoadStart) * 1000.0 << " ms" << std::endl;
+        sceneFile.close();  // Everything has been copied into GL buffers and the Scene
+    } else if (options.benchmark) {
+        // Benchmark scene: a square grid of N cubes with seeded heights and spins, identical every run
+        int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(options.benchmarkCubes))));
+        const float spacing = 2.5f;
+        uint32_t seed = 12345u;
+        auto random = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / 16777216.0f;
+        };
+        float origin = -0.5f * spacing * static_cast<float>(side - 1);
+        for (int i = 0; i < options.benchmarkCubes; ++i) {
+            float x = origin + spacing * static_cast<float>(i % side);
+            float z = origin + spacing * static_cast<float>(i / side);
+            Vec3 position{x, terrainHeight(x, z) + 1.0f + random() * 2.0f, z};
+            scene.create(position, {0.0f, random() * 6.2831853f, 0.0f}, {1.0f, 1.0f, 1.0f},
+                         colorPalette[static_cast<size_t>(i) % colorPalette.size()], cubeCullExtent,
+                         cubeCollisionExtent, cubeMeshId);
+        }
+    } else {
+        for (size_t i = 0; i < cubePositions.size(); ++i) {
+            scene.create(cubePositions[i], {0.0f, static_cast<float>(i) * 0.6f, 0.0f}, {1.0f, 1.0f, 1.0f},
+                         colorPalette[i % colorPalette.size()], cubeCullExtent, cubeCollisionExtent, cubeMeshId);
+        }
+    }
+    if (!options.exportScenePath.empty()) {
+        std::vector<SceneMeshLod> meshLods;
+        for (size_t mesh = 0; mesh < meshLibrary.meshes.size(); ++mesh) {
+            for (int level = 0; level < MeshLibrary::lodCount; ++level) {
+                meshLods.push_back({static_cast<uint32_t>(mesh), static_cast<uint32_t>(level),
+                                    meshLibrary.lod(static_cast<uint16_t>(mesh), level)});
+            }
+        }
+        if (writeSceneFile(options.exportScenePath, cubeVertices, cubeIndices, meshLods, scene)) {
+            std::cout << "Wrote " << scene.size() << " objects to " << options.exportScenePath << std::endl;
+        } else {
+            std::cerr << "Could not write scene " << options.exportScenePath << std::endl;
+        }
+    }
+    cubeVertices = {};
+    cubeIndices = {};
+    // Worst frame: every prop visible and a caster in all three cascades
+    streamRing.reserve(scene.size() * (sizeof(Vec3) + (1 + ShadowCascades::count) * sizeof(Mat4)) + (64 << 10));
+
+    // Point lights placed off the props: even ones are flickering torches on top of a prop,
+    // odd ones are pickups bobbing beside it. Seeded, so benchmark runs see the same lights.
+    std::vector<PointLight> lightBase;
+    std::vector<float> lightPhase;
+    if (scene.size() > 0) {
+        size_t count = std::min(static_cast<size_t>(std::max(options.lightCount, 0)),
+                                static_cast<size_t>(ClusteredLights::maxLights));
+        uint32_t seed = 777u;
+        auto random = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / 16777216.0f;
+        };
+        for (size_t i = 0; i < count; ++i) {
+            Vec3 prop = scene.position[i * scene.size() / count];
+            bool torch = i % 2 == 0;
+            float angle = random() * 6.2831853f;
+            Vec3 offset = torch ? Vec3{0.0f, 1.2f, 0.0f} : Vec3{1.5f * std::cos(angle), 0.6f, 1.5f * std::sin(angle)};
+            lightBase.push_back({add(prop, offset), torch ? 5.0f + 3.0f * random() : 3.0f + 2.0f * random(),
+                                 torch ? Vec3{1.0f, 0.55f, 0.2f} : Vec3{0.3f, 0.8f, 1.0f}, torch ? 2.5f : 1.8f});
+            lightPhase.push_back(random() * 6.2831853f);
+        }
+    }
+    std::vector<PointLight> lights(lightBase.size());
+
     float cubeRotationSpeed = 1.8f;
-    float cameraSpeed = 3.0f;
-    float cameraRadius = 0.35f;
+
+    // Physics runs on its own thread against a snapshot of the prop colliders
+    Simulation simulation;
+    simulation.world = buildCollisionWorld(scene);
+    PlayerState initialPlayer;
+    initialPlayer.position = cameraPos;
+    if (!options.benchmark) simulation.start(initialPlayer);
+
+    // Benchmark runs follow a camera path at a fixed timestep instead of reading input
+    const float benchmarkTimestep = 1.0f / 60.0f;
+    std::vector<CameraKey> cameraPath;
+    if (options.benchmark) {
+        if (!options.cameraPath.empty() && !loadCameraPath(options.cameraPath, cameraPath)) {
+            std::cerr << "Could not read camera path " << options.cameraPath << ", using the default orbit" << std::endl;
+        }
+        if (cameraPath.empty()) {
+            float extent = 0.5f * 2.5f * std::sqrt(static_cast<float>(std::max(options.benchmarkCubes, 1)));
+            cameraPath = orbitCameraPath(std::max(extent, 8.0f), 16.0f, 20.0f);
+        }
+    }
+    int benchmarkFrame = 0;
+    uint64_t warmupShadowRenders = 0;  // Cascade renders before measuring started
+
+    // Have the tiles around the start position resident before the first frame
+    Vec3 startPos = cameraPos;
+    if (options.benchmark) sampleCameraPath(cameraPath, 0.0f, startPos, cameraFront);
+    terrain.update(startPos, jobs, 1 << 30);
+    terrain.finishPending(jobs);
+
+    // BVH over the scene's culling bounds; rebuilt whenever objects are added or removed
+    Bvh propBvh;
+    propBvh.build(scene.bounds);
+    uint32_t bvhSceneVersion = scene.structureVersion;
+    uint32_t shadowSceneVersion = scene.structureVersion;
+    bool useInstancing = true;
+    bool useDepthPrepass = options.depthPrepass;
+
+    // GPU-driven props (--gpu-cull, O toggles): culled, LOD-selected and composed by a compute
+    // shader against mirrored scene columns. Needs GL 4.3; steps aside while instancing is off.
+    // Initialised the first time it is wanted, so O works without --gpu-cull.
+    GpuCulling gpuCulling;
+    bool useGpuCulling = options.gpuCulling;
+    bool gpuCullingTried = false;
+    bool gpuSceneUploaded = false, gpuRotationsStale = false;
+    uint32_t gpuSceneVersion = 0;
+
+    // Everything that lives for one frame (visible lists, instance data) comes from here
+    FrameArena frameArena(1 << 20);
+
+    // What the render passes read each frame; the frame loop fills it in before running them
+    struct FrameContext {
+        Frustum frustum{};
+        Vec3 cameraPos{};
+        LodRanges lod{};
+        const uint32_t* drawOrder = nullptr;  // Visible props in runs of one LOD and mesh, each front to back
+        size_t propCount = 0;
+        const DrawCommand* propCommands = nullptr;  // One per run; instances index drawOrder
+        size_t propCommandCount = 0;
+        const Mat4* propModels = nullptr;
+        StreamRing::Allocation frameData;     // FrameUniforms for the camera
+        StreamRing::Allocation propMatrices;  // propModels' ring range (instanced path)
+        bool gpuProps = false;  // Props come from GpuCulling's buffers instead of the lists above
+        Mat4 viewProjection{};
+        int width = 0, height = 0;                // Render resolution (scene target viewport)
+        int displayWidth = 0, displayHeight = 0;  // Window framebuffer
+    } frame;
+
+    // Opaque geometry (terrain, then props) with the given programs. Drawn once, or twice
+    // with the prepass: depth only, then shading against the finished depth buffer.
+    struct OpaqueUniforms {
+        const DrawProgram& terrain;
+        const DrawProgram& props;
+        const char* terrainLabel;
+        const char* propsLabel;
+    };
+    StreamRing::Allocation propTints, propIndirect;  // Written by "instance upload"
+    auto drawOpaque = [&](const OpaqueUniforms& pass) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textureOrChecker(groundTexture));
+        {
+            GpuScope gpuScope(pass.terrainLabel);
+            const DrawProgram& draw = pass.terrain;
+            glUseProgram(draw.program->id);
+            glUniform1i(draw.instanced, GL_FALSE);
+            Mat4 terrainModel = identity();  // Tiles are generated in world space
+            glUniformMatrix4fv(draw.model, 1, GL_FALSE, terrainModel.m);
+            glUniform3f(draw.tint, groundTint.x, groundTint.y, groundTint.z);
+            terrain.draw(frame.frustum, frame.cameraPos, frame.lod, draw.lod);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, textureOrChecker(propTexture));
+        GpuScope gpuScope(pass.propsLabel);
+        const DrawProgram& draw = pass.props;
+        glUseProgram(draw.program->id);
+        if (frame.gpuProps) {
+            glUniform1i(draw.instanced, GL_TRUE);
+            meshLibrary.draw(gpuCulling.commandBuffer, 0, gpuCulling.commandTemplate.data(), gpuCulling.commandCount(),
+                             {gpuCulling.matrixBuffer, 0, gpuCulling.tintBuffer, 0});
+        } else if (useInstancing) {
+            glUniform1i(draw.instanced, GL_TRUE);
+            meshLibrary.draw(propIndirect.buffer, propIndirect.offset, frame.propCommands, frame.propCommandCount,
+                             {frame.propMatrices.buffer, frame.propMatrices.offset, propTints.buffer, propTints.offset});
+        } else {
+            glUniform1i(draw.instanced, GL_FALSE);
+            glBindVertexArray(meshLibrary.vao);
+            for (size_t c = 0; c < frame.propCommandCount; ++c) {
+                const DrawCommand& command = frame.propCommands[c];
+                for (size_t n = command.baseInstance; n < command.baseInstance + command.instanceCount; ++n) {
+                    const Vec3& tint = scene.tint[frame.drawOrder[n]];
+                    glUniformMatrix4fv(draw.model, 1, GL_FALSE, frame.propModels[n].m);
+                    glUniform3f(draw.tint, tint.x, tint.y, tint.z);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_SHORT,
+                                             (void*)(command.firstIndex * sizeof(GLushort)), command.baseVertex);
+                }
+            }
+        }
+    };
+
+    // Frame passes in execution order. Opaque geometry goes first so the sky, drawn last at
+    // max depth, only runs its fragment shader where nothing else covered the pixel.
+    RenderGraph renderGraph;
+    renderGraph.add("shadow cascades", [&]() {
+        // Re-render dirty cascades only; casters are terrain and props, props at their coarse LOD
+        glUseProgram(depthProgram.id);
+        glUniformMatrix4fv(depthDraw.model, 1, GL_FALSE, identity().m);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        for (int i = 0; i < ShadowCascades::count; ++i) {
+            ShadowCascades::Cascade& cascade = shadows.cascades[i];
+            if (!cascade.dirty) continue;
+            static const char* const labels[ShadowCascades::count] = {"shadow cascade 0", "shadow cascade 1",
+                                                                      "shadow cascade 2"};
+            GpuScope gpuScope(labels[i]);
+            FrameUniforms lightUniforms{};
+            lightUniforms.view = cascade.view;
+            lightUniforms.projection = cascade.projection;
+            StreamRing::Allocation lightFrame = streamRing.pushUniforms(lightUniforms);
+
+            FrameVector<uint32_t> casters(frameArena);
+            casters.reserve(scene.size());
+            cullParallel(propBvh, cascade.frustum, scene.bounds, casters, jobs, frameArena);
+            FrameVector<DrawCommand> commands(frameArena);
+            StreamRing::Allocation models, indirect;
+            if (!casters.empty()) {
+                groupByMesh(casters.data(), casters.size(), scene.meshId.data(), meshLibrary.meshes.size(), frameArena);
+                meshLibrary.appendCommands(casters.data(), 0, casters.size(), scene.meshId.data(),
+                                           MeshLibrary::lodCount - 1, commands);
+                models = streamRing.allocate(casters.size() * sizeof(Mat4));
+                Mat4* out = reinterpret_cast<Mat4*>(models.data);
+                jobs.parallelFor(casters.size(), 2048, [&](size_t begin, size_t end) {
+                    composeTransforms(scene.position.data(), scene.rotation.data(), scene.scale.data(),
+                                      casters.data() + begin, end - begin, out + begin);
+                });
+                if (meshLibrary.multiDraw) indirect = streamRing.push(commands.data(), commands.size() * sizeof(DrawCommand));
+            }
+            streamRing.flush();
+            glBindBufferRange(GL_UNIFORM_BUFFER, frameDataBinding, lightFrame.buffer, lightFrame.offset,
+                              sizeof(FrameUniforms));
+            shadows.beginRender(i);
+
+            // One fixed, unmorphed level per cascade: the cascade is cached while the camera moves
+            // and its LOD cut changes, so casters must not depend on the cut itself
+            glUniform1i(depthDraw.instanced, GL_FALSE);
+            terrain.draw(cascade.frustum, frame.cameraPos, frame.lod, depthDraw.lod, cascade.terrainLevel);
+
+            if (!casters.empty()) {
+                glBindVertexArray(meshLibrary.vao);
+                glDisableVertexAttribArray(7);  // Depth only: no tints needed
+                glUniform1i(depthDraw.instanced, GL_TRUE);
+                meshLibrary.draw(indirect.buffer, indirect.offset, commands.data(), commands.size(),
+                                 {models.buffer, models.offset, 0, 0});
+                glEnableVertexAttribArray(7);
+            }
+            cascade.dirty = false;
+            ++shadows.renders;
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindBufferRange(GL_UNIFORM_BUFFER, frameDataBinding, frame.frameData.buffer, frame.frameData.offset,
+                          sizeof(FrameUniforms));  // "clear" rebinds the scene target
+    });
+    renderGraph.add("clear", [&]() {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget.fbo);
+        glViewport(0, 0, frame.width, frame.height);
+        glClearColor(0.05f, 0.08f, 0.12f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    });
+    renderGraph.add("instance upload", [&]() {
+        // Matrices were composed straight into the ring; tints and commands follow them
+        propTints = streamRing.allocate(frame.propCount * sizeof(Vec3));
+        Vec3* instanceTints = reinterpret_cast<Vec3*>(propTints.data);
+        for (size_t n = 0; n < frame.propCount; ++n) instanceTints[n] = scene.tint[frame.drawOrder[n]];
+        if (meshLibrary.multiDraw) {
+            propIndirect = streamRing.push(frame.propCommands, frame.propCommandCount * sizeof(DrawCommand));
+        }
+        streamRing.flush();
+    });
+    renderGraph.add("gpu cull", [&]() {
+        GpuScope gpuScope("gpu cull");
+        gpuCulling.cull(streamRing, frame.frustum, frame.cameraPos, frame.lod.propDetail, frame.lod.fogHidden + cubeCullExtent);
+    });
+    renderGraph.add("depth prepass", [&]() {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        drawOpaque({depthDraw, depthDraw, "prepass terrain", "prepass props"});
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    });
+    renderGraph.add("opaque", [&]() {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, skyEnvTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadows.texture);
+        clusteredLights.bind(GL_TEXTURE3);
+        if (renderGraph.isEnabled("depth prepass")) {
+            // Depth is final: shade only the surviving fragment of each pixel
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        drawOpaque({materialDraws[static_cast<int>(Material::Terrain)], materialDraws[static_cast<int>(Material::Prop)],
+                    "terrain", "props"});
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    });
+    renderGraph.add("hi-z build", [&]() {
+        // Opaque depth is final here (the sky writes none): next frame's occlusion test reads it
+        GpuScope gpuScope("hi-z build");
+        gpuCulling.buildPyramid(sceneTarget.depth, frame.width, frame.height, sceneTarget.capacityWidth,
+                                sceneTarget.capacityHeight, frame.viewProjection);
+    });
+    renderGraph.add("sky", [&]() {
+        // z = w puts the sky at depth 1.0: LEQUAL passes only where the clear value survived
+        GpuScope gpuScope("sky");
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glUseProgram(skyboxProgram.id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
+        glBindVertexArray(skyboxVAO);
+        glDrawElements(GL_TRIANGLES, skyboxIndexCount, GL_UNSIGNED_SHORT, nullptr);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    });
+    renderGraph.add("present", [&]() {
+        GpuScope gpuScope("present");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, frame.displayWidth, frame.displayHeight);
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(presentProgram.id);
+        float capacityWidth = static_cast<float>(sceneTarget.capacityWidth);
+        float capacityHeight = static_cast<float>(sceneTarget.capacityHeight);
+        glUniform2f(presentUvScale, frame.width / capacityWidth, frame.height / capacityHeight);
+        glUniform2f(presentUvMax, (frame.width - 0.5f) / capacityWidth, (frame.height - 0.5f) / capacityHeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneTarget.color);
+        glBindVertexArray(presentVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    });
+
+    profiler.keepHistory = options.benchmark || !options.profileCsvPath.empty() || !options.tracePath.empty();
+    profiler.blockOnGpu = profiler.keepHistory;  // Complete statistics over never stalling
+    double lastOverlayUpdate = 0.0;
 
     while (!glfwWindowShouldClose(window)) {
+        framePacer.wait();  // Outside the profiled frame, like the swap
+        if (options.benchmark && benchmarkFrame == options.warmupFrames) {
+            profiler.discardHistory();
+            warmupShadowRenders = shadows.renders;
+        }
+        profiler.beginFrame();
+        frameArena.reset();
+        streamRing.beginFrame();
+        FrameVector<uint32_t> visibleProps(frameArena);
+        FrameVector<uint32_t> propDrawOrder(frameArena);  // Visible props grouped by LOD, each group front to back
+        FrameVector<DrawCommand> propCommands(frameArena);
+        visibleProps.reserve(scene.size());
+        propDrawOrder.reserve(scene.size());
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window, cubeRotation, cubeRotationSpeed);
+        {
+            ProfileScope scope("asset uploads");
+            assets.update(jobs, assetUploadBudgetMs);
+        }
+        if (!options.benchmark && shaders.poll(nowSeconds())) configurePrograms();
+
+        // Events are gathered after pacing and uploads, as close as possible to where they're used,
+        // and the look is applied at once so movement and the view share this frame's heading
+        pollInput();
+        if (!options.benchmark) {
+            double inputMs = applyMouseLook();
+            if (inputMs >= 0.0) profiler.markInput(inputMs);
+        }
+        Vec3 cubeRotationDelta{0.0f, 0.0f, 0.0f};
+        if (options.benchmark) {
+            // Simulated time advances by a fixed step per frame, independent of wall time
+            deltaTime = benchmarkTimestep;
+            if (options.spinProps) cubeRotationDelta.y = 0.5f * benchmarkTimestep;
+        } else {
+            processInput(window, cubeRotationDelta, cubeRotationSpeed, useInstancing, useDepthPrepass, useGpuCulling);
+        }
+        if (useGpuCulling && !gpuCulling.supported) {
+            if (gpuCullingTried || !gpuCulling.init()) {
+                std::cerr << "GPU culling needs OpenGL 4.3 compute shaders, using the CPU path" << std::endl;
+                useGpuCulling = false;
+            }
+            gpuCullingTried = true;
+        }
+        if (dot(cubeRotationDelta, cubeRotationDelta) > 0.0f) {
+            ProfileScope scope("rotate props");
+            jobs.parallelFor(scene.size(), 8192, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) scene.rotation[i] = add(scene.rotation[i], cubeRotationDelta);
+            });
+            gpuRotationsStale = true;
+        }
 
         // Calculate horizontal movement direction (WASD keys)
         Vec3 movement{0.0f, 0.0f, 0.0f};
-        Vec3 right = normalize(cross(cameraFront, cameraUp));
-        
+
         // Get forward direction projected onto XZ plane (horizontal only)
         Vec3 forward = normalize({cameraFront.x, 0.0f, cameraFront.z});
         Vec3 strafeRight = normalize(cross(forward, cameraUp));
-        
+
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) movement = add(movement, forward);
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) movement = sub(movement, forward);
         if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) movement = sub(movement, strafeRight);
         if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) movement = add(movement, strafeRight);
 
-        // Apply horizontal movement with collision detection
-        if (dot(movement, movement) > 0.0f) {
-            movement = normalize(movement);
-            Vec3 nextPos = add(cameraPos, mul(movement, cameraSpeed * deltaTime));
+        if (options.benchmark) {
+            sampleCameraPath(cameraPath, static_cast<float>(benchmarkFrame) * benchmarkTimestep, cameraPos, cameraFront);
+        } else {
+            PlayerInput input;
+            input.move = normalize(movement);
+            input.jump = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+            simulation.setInput(input);
+            cameraPos = simulation.interpolatedPosition(nowSeconds());
+        }
 
-            bool collided = false;
-            for (const auto& pos : cubePositions) {
-                Vec3 min = sub(pos, {0.6f, 0.6f, 0.6f});
-                Vec3 max = add(pos, {0.6f, 0.6f, 0.6f});
-                if (sphereAabbCollision(nextPos, cameraRadius, min, max)) {
-                    collided = true;
-                    break;
-                }
+        int width = 1600;
+        int height = 900;
+        glfwGetFramebufferSize(window, &width, &height);
+        width = std::max(width, 1);
+        height = std::max(height, 1);
+        sceneTarget.resize(width, height);
+        dynamicResolution.update(profiler.latestGpuMs);
+        const int renderWidth = dynamicResolution.scaled(width);
+        const int renderHeight = dynamicResolution.scaled(height);
+
+        float aspect = static_cast<float>(width) / static_cast<float>(height);
+        const float fovY = 45.0f * 3.14159265f / 180.0f;
+        const float nearZ = 0.1f, farZ = 140.0f;
+        Mat4 projection = perspective(fovY, aspect, nearZ, farZ);
+        Mat4 view = lookAt(cameraPos, add(cameraPos, cameraFront), cameraUp);
+
+        // multiply(a, b) applies a first, so this is projection * view
+        Mat4 viewProjection = multiply(view, projection);
+        Frustum frustum = extractFrustum(viewProjection);
+        {
+            ProfileScope scope("terrain stream");
+            terrain.update(cameraPos, jobs);
+        }
+        // The BVH stays current either way: the shadow pass culls casters through it
+        const bool gpuProps = useGpuCulling && gpuCulling.supported && useInstancing;
+        {
+            ProfileScope scope("cull");
+            if (bvhSceneVersion != scene.structureVersion) {
+                propBvh.build(scene.bounds);
+                bvhSceneVersion = scene.structureVersion;
             }
-            if (!collided) {
-                cameraPos = nextPos;
+            if (!gpuProps) cullParallel(propBvh, frustum, scene.bounds, visibleProps, jobs, frameArena);
+        }
+        if (gpuProps) {
+            ProfileScope scope("gpu scene sync");
+            if (!gpuSceneUploaded || gpuSceneVersion != scene.structureVersion) {
+                gpuCulling.uploadScene(scene, meshLibrary);
+                gpuSceneUploaded = true;
+                gpuSceneVersion = scene.structureVersion;
+            } else if (gpuRotationsStale) {
+                gpuCulling.uploadRotations(scene, streamRing);
             }
+            gpuRotationsStale = false;
+        } else {
+            gpuCulling.invalidate();  // Not rebuilt while the CPU path runs
         }
 
-        // Jump input (only when grounded)
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && isGrounded) {
-            velocityY = jumpSpeed;
-            isGrounded = false;
-        }
+        // Same thresholds drive terrain refinement and prop LOD
+        LodRanges lod = computeLodRanges(fovY, height, fogDensity);
+        {
+            // Group visible props by LOD and sort each group front to back; fogged-out props are dropped.
+            // Keys are (squared distance bits, index): non-negative floats order like their bit patterns.
+            ProfileScope scope("prop lod + sort");
+            float detail2 = lod.propDetail * lod.propDetail;
+            float hidden = lod.fogHidden + cubeCullExtent;
+            FrameVector<uint64_t> nearKeys(frameArena), farKeys(frameArena);
+            nearKeys.reserve(visibleProps.size());
+            farKeys.reserve(visibleProps.size());
+            for (uint32_t i : visibleProps) {
+                Vec3 d = sub(scene.position[i], cameraPos);
+                float dist2 = dot(d, d);
+                if (dist2 > hidden * hidden) continue;
+                uint32_t bits = 0;
+                std::memcpy(&bits, &dist2, sizeof(bits));
+                (dist2 <= detail2 ? nearKeys : farKeys).push_back(static_cast<uint64_t>(bits) << 32 | i);
+            }
+            std::sort(nearKeys.begin(), nearKeys.end());
+            std::sort(farKeys.begin(), farKeys.end());
+            for (uint64_t key : nearKeys) propDrawOrder.push_back(static_cast<uint32_t>(key));
+            for (uint64_t key : farKeys) propDrawOrder.push_back(static_cast<uint32_t>(key));
 
-        // Apply gravity to vertical velocity
-        velocityY += gravity * deltaTime;
+            // Runs of one mesh inside each LOD group become one draw command each
+            size_t groups[MeshLibrary::lodCount + 1] = {0, nearKeys.size(), propDrawOrder.size()};
+            for (int level = 0; level < MeshLibrary::lodCount; ++level) {
+                groupByMesh(propDrawOrder.data() + groups[level], groups[level + 1] - groups[level],
+                            scene.meshId.data(), meshLibrary.meshes.size(), frameArena);
+                meshLibrary.appendCommands(propDrawOrder.data(), groups[level], groups[level + 1],
+                                           scene.meshId.data(), level, propCommands);
+            }
+        }
 
-        // Apply vertical velocity to camera position
-        cameraPos.y += velocityY * deltaTime;
+        FrameUniforms frameUniforms{};
+        frameUniforms.view = view;
+        frameUniforms.projection = projection;
+        frameUniforms.viewPos[0] = cameraPos.x;
+        frameUniforms.viewPos[1] = cameraPos.y;
+        frameUniforms.viewPos[2] = cameraPos.z;
+        frameUniforms.lightDir[0] = sunDirection.x;
+        frameUniforms.lightDir[1] = sunDirection.y;
+        frameUniforms.lightDir[2] = sunDirection.z;
+        frame.frameData = streamRing.pushUniforms(frameUniforms);
+        glBindBufferRange(GL_UNIFORM_BUFFER, frameDataBinding, frame.frameData.buffer, frame.frameData.offset,
+                          sizeof(FrameUniforms));
 
-        // Ground collision - player's feet position is cameraPos.y - playerHeight
-        float feetY = cameraPos.y - playerHeight;
-        if (feetY <= groundLevel) {
-            cameraPos.y = groundLevel + playerHeight;
-            velocityY = 0.0f;
-            isGrounded = true;
+        // Per-frame prop data, shared by every pass that draws props
+        frame.frustum = frustum;
+        frame.cameraPos = cameraPos;
+        frame.lod = lod;
+        frame.drawOrder = propDrawOrder.data();
+        frame.propCount = propDrawOrder.size();
+        frame.propCommands = propCommands.data();
+        frame.propCommandCount = propCommands.size();
+        // Instanced draws read the matrices straight from the ring; the per-object path reads them on the CPU
+        Mat4* propModels = nullptr;
+        if (useInstancing && !gpuProps) {
+            frame.propMatrices = streamRing.allocate(frame.propCount * sizeof(Mat4));
+            propModels = reinterpret_cast<Mat4*>(frame.propMatrices.data);
         } else {
-            isGrounded = false;
+            propModels = frameArena.allocateArray<Mat4>(frame.propCount);
+        }
+        {
+            ProfileScope scope("compose transforms");
+            jobs.parallelFor(frame.propCount, 2048, [&](size_t begin, size_t end) {
+                composeTransforms(scene.position.data(), scene.rotation.data(), scene.scale.data(),
+                                  propDrawOrder.data() + begin, end - begin, propModels + begin);
+            });
         }
+        frame.propModels = propModels;
+        frame.gpuProps = gpuProps;
+        frame.viewProjection = viewProjection;
+        frame.width = renderWidth;
+        frame.height = renderHeight;
+        frame.displayWidth = width;
+        frame.displayHeight = height;
 
-        int width = 1600;
-        int height = 900;
-        glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
+        // Cached cascades: re-fit on camera/sun movement, re-render where casters changed.
+        // Every prop is a caster and they all rotate together, so rotation dirties everything.
+        shadows.update(cameraPos, sunDirection, lod);
+        if (dot(cubeRotationDelta, cubeRotationDelta) > 0.0f || shadowSceneVersion != scene.structureVersion) {
+            shadows.invalidateAll();
+            shadowSceneVersion = scene.structureVersion;
+        }
+        for (const Aabb& box : terrain.changedBounds) shadows.invalidate(box);
+        if (shadows.anyDirty()) {
+            ShadowCascades::Uniforms shadowUniforms = shadows.uniforms();
+            glBindBuffer(GL_UNIFORM_BUFFER, shadowDataUBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(shadowUniforms), &shadowUniforms);
+        }
 
-        glClearColor(0.05f, 0.08f, 0.12f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (pointLights) {
+            ProfileScope scope("light binning");
+            float time = options.benchmark ? static_cast<float>(benchmarkFrame) * benchmarkTimestep : currentFrame;
+            for (size_t i = 0; i < lights.size(); ++i) {
+                lights[i] = lightBase[i];
+                if (i % 2 == 0) {
+                    lights[i].intensity *= 0.85f + 0.15f * std::sin(time * 11.0f + lightPhase[i]);
+                } else {
+                    lights[i].position.y += 0.3f * std::sin(time * 2.0f + lightPhase[i]);
+                }
+            }
+            clusteredLights.setProjection(fovY, aspect, nearZ, farZ, renderWidth, renderHeight);
+            clusteredLights.build(lights.data(), lights.size(), view, jobs);
+            StreamRing::Allocation lightGrid = streamRing.pushUniforms(clusteredLights.uniforms);
+            glBindBufferRange(GL_UNIFORM_BUFFER, lightGridBinding, lightGrid.buffer, lightGrid.offset,
+                              sizeof(ClusteredLights::Uniforms));
+        }
 
-        float aspect = static_cast<float>(width) / static_cast<float>(height);
-        Mat4 projection = perspective(45.0f * 3.14159265f / 180.0f, aspect, 0.1f, 140.0f);
-        Mat4 view = lookAt(cameraPos, add(cameraPos, cameraFront), cameraUp);
+        renderGraph.setEnabled("shadow cascades", sunShadows && shadows.anyDirty());
+        renderGraph.setEnabled("instance upload", useInstancing && !gpuProps);
+        renderGraph.setEnabled("gpu cull", gpuProps);
+        renderGraph.setEnabled("hi-z build", gpuProps);
+        renderGraph.setEnabled("depth prepass", useDepthPrepass);
+        streamRing.flush();
+        renderGraph.execute();
+        profiler.markPresent();
+        streamRing.endFrame();
 
-        // Render skybox first (with depth write disabled, depth test LEQUAL)
-        glDepthFunc(GL_LEQUAL);
-        glUseProgram(skyboxProgram);
-        glUniformMatrix4fv(glGetUniformLocation(skyboxProgram, "uView"), 1, GL_FALSE, view.m);
-        glUniformMatrix4fv(glGetUniformLocation(skyboxProgram, "uProjection"), 1, GL_FALSE, projection.m);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-        glUniform1i(glGetUniformLocation(skyboxProgram, "uSkybox"), 0);
-        glBindVertexArray(skyboxVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthFunc(GL_LESS);  // Restore default depth function
+        profiler.endFrame();
+        if (currentFrame - lastOverlayUpdate > 0.5f) {
+            std::string title = "3D Overworld | " + profiler.overlayText() + " | render " +
+                                std::to_string(static_cast<int>(dynamicResolution.scale * 100.0f + 0.5f)) + "% | arena " +
+                                std::to_string(frameArena.highWater / 1024) + " KB";
+            glfwSetWindowTitle(window, title.c_str());
+            lastOverlayUpdate = currentFrame;
+        }
 
-        glUseProgram(program);
-        glUniform3f(glGetUniformLocation(program, "uLightDir"), -0.25f, -1.0f, -0.35f);
-        glUniform3f(glGetUniformLocation(program, "uViewPos"), cameraPos.x, cameraPos.y, cameraPos.z);
-        glUniform3f(glGetUniformLocation(program, "uFogColor"), 0.35f, 0.45f, 0.65f);
-        glUniform1f(glGetUniformLocation(program, "uFogDensity"), 0.03f);
-        glUniformMatrix4fv(glGetUniformLocation(program, "uView"), 1, GL_FALSE, view.m);
-        glUniformMatrix4fv(glGetUniformLocation(program, "uProjection"), 1, GL_FALSE, projection.m);
+        glfwSwapBuffers(window);
+        framePacer.endFrame();
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-        glUniform1i(glGetUniformLocation(program, "uEnvMap"), 1);
+        if (options.benchmark && ++benchmarkFrame >= options.warmupFrames + options.benchmarkFrames) {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+    }
 
-        glBindVertexArray(groundVAO);
-        Mat4 groundModel = multiply(translate({0.0f, -1.0f, 0.0f}), scale(groundScale));
-        glUniformMatrix4fv(glGetUniformLocation(program, "uModel"), 1, GL_FALSE, groundModel.m);
-        glUniform3f(glGetUniformLocation(program, "uColorTint"), groundTint.x, groundTint.y, groundTint.z);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    simulation.stop();
+    terrain.destroy(jobs);
+    assets.destroy(jobs);
+    jobs.stop();
 
-        glBindVertexArray(VAO);
-        for (size_t i = 0; i < cubePositions.size(); ++i) {
-            Vec3 pos = cubePositions[i];
-            Vec3 tint = colorPalette[i % colorPalette.size()];
-            Mat4 model = multiply(translate(pos), multiply(rotateY(cubeRotation.y + static_cast<float>(i) * 0.6f),
-                             multiply(rotateX(cubeRotation.x), rotateZ(cubeRotation.z))));
-            glUniformMatrix4fv(glGetUniformLocation(program, "uModel"), 1, GL_FALSE, model.m);
-            glUniform3f(glGetUniformLocation(program, "uColorTint"), tint.x, tint.y, tint.z);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        }
+    if (profiler.keepHistory) {
+        std::cout << "memory: frame arena peak " << frameArena.highWater / 1024 << " of " << frameArena.capacity / 1024
+                  << " KB (" << frameArena.overflowFrames << " frames spilled), physics step arena peak "
+                  << simulation.stepArena.highWater << " of " << simulation.stepArena.capacity << " bytes, terrain tiles peak "
+                  << terrain.chunkPool.highWater << " of " << terrain.chunkPool.capacity() << ", stream ring peak "
+                  << streamRing.highWater / 1024 << " of " << streamRing.regionSize / 1024 << " KB per frame ("
+                  << streamRing.stalls << " stalls)" << std::endl;
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    profiler.flush();
+    if (options.benchmark) {
+        std::cout << "benchmark: " << scene.size() << " cubes, " << options.benchmarkFrames
+                  << " frames after " << options.warmupFrames << " warm-up, " << shadows.renders - warmupShadowRenders
+                  << " shadow cascade renders" << (options.spinProps ? " (--spin-props: all cascades every frame)" : "")
+                  << std::endl;
+    }
+    if (profiler.keepHistory) profiler.printSummary(std::cout);
+    if (!options.profileCsvPath.empty() && !profiler.writeCsv(options.profileCsvPath)) {
+        std::cerr << "Could not write " << options.profileCsvPath << std::endl;
+    }
+    if (!options.tracePath.empty() && !profiler.writeChromeTrace(options.tracePath)) {
+        std::cerr << "Could not write " << options.tracePath << std::endl;
     }
 
-    glDeleteVertexArrays(1, &groundVAO);
-    glDeleteBuffers(1, &groundVBO);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    meshLibrary.destroy();
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &skyboxVBO);
-    glDeleteProgram(program);
-    glDeleteProgram(skyboxProgram);
+    glDeleteBuffers(1, &skyboxEBO);
+    glDeleteVertexArrays(1, &presentVAO);
+    sceneTarget.destroy();
+    glDeleteBuffers(1, &shadowDataUBO);
+    shadows.destroy();
+    clusteredLights.destroy();
+    gpuCulling.destroy();
+    streamRing.destroy();
+    framePacer.destroy();
+    shaders.destroy();
     glDeleteTextures(1, &texture);
     glDeleteTextures(1, &skyboxTexture);
+    glDeleteTextures(1, &skyEnvTexture);
     glfwTerminate();
     return 0;
 }